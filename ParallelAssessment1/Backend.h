@@ -0,0 +1,197 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <sstream>
+
+#include "Functions.h"
+#include "NativeStats.h"
+#include "StatsEngine.h"
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+//where the statistics are worked out
+enum BackendKind {
+	BACKEND_AUTO, //native below opencl_min_elements values or when there is no device, OpenCL otherwise
+	BACKEND_OPENCL,
+	BACKEND_NATIVE
+};
+
+//parse a backend given on the command line, falls back to auto for anything unknown
+BackendKind parseBackend(const string& name)
+{
+	if (name == "opencl") return BACKEND_OPENCL;
+	if (name == "native") return BACKEND_NATIVE;
+	return BACKEND_AUTO;
+}
+
+const char* backendName(BackendKind kind)
+{
+	switch (kind) {
+	case BACKEND_OPENCL: return "opencl";
+	case BACKEND_NATIVE: return "native";
+	default: return "auto";
+	}
+}
+
+//smallest dataset auto sends to the device, below it the upload and kernel launches take longer than the native threads
+//need for the whole query (a 16 MB memory bound pass is a few ms on the host)
+const size_t opencl_min_elements = 1 << 22;
+
+//backend to use for nr_elements values, written to the log with the reason
+//asking for OpenCL without a working device falls back to native rather than failing
+BackendKind chooseBackend(BackendKind wanted, size_t nr_elements, bool device_ready, std::ostream& log = std::cout)
+{
+	BackendKind kind;
+	string reason;
+	if (!device_ready) {
+		kind = BACKEND_NATIVE;
+		reason = "no OpenCL device could be set up";
+	}
+	else if (wanted != BACKEND_AUTO) {
+		kind = wanted;
+		reason = "chosen on the command line";
+	}
+	else if (nr_elements < opencl_min_elements) {
+		kind = BACKEND_NATIVE;
+		reason = std::to_string(nr_elements) + " values is below " + std::to_string(opencl_min_elements);
+	}
+	else {
+		kind = BACKEND_OPENCL;
+		reason = std::to_string(nr_elements) + " values is at least " + std::to_string(opencl_min_elements);
+	}
+
+	log << "Backend: " << backendName(kind);
+	if (kind == BACKEND_NATIVE)
+		log << " (" << nativeDescription() << ")";
+	log << ", " << reason << std::endl;
+	return kind;
+}
+
+//every statistic the menu asks for, behind one interface so callers do not care whether it runs on an OpenCL device or on the host
+class StatsBackend {
+public:
+	virtual ~StatsBackend() {}
+	virtual BackendKind kind() const = 0;
+	virtual Summary summary(DataView A) = 0;
+	virtual mytype min(DataView A) = 0;
+	virtual mytype max(DataView A) = 0;
+	virtual double mean(DataView A) = 0;
+	virtual Moments moments(DataView A) = 0;
+	virtual vector<double> percentiles(DataView A, const vector<double>& ps) = 0;
+	virtual vector<Summary> summaryByKey(DataView A, const cl_uchar* keys, int nr_keys) = 0; //keys 1..nr_keys, one per value
+	virtual Histogram histogram(DataView A, const BinLayout& layout) = 0;
+	virtual Histogram histogram(DataView A, int nr_bins) = 0;
+};
+
+//the statistics engine, the data goes to the device on the first call and stays there for the next ones on the same values
+//so the queries share one upload (or in place wrap) and use the reduction and mean precision the engine was set up with
+class OpenCLBackend : public StatsBackend {
+public:
+	OpenCLBackend(StatsEngine& engine) : engine(engine), id(-1), data(NULL), nr_elements(0), attached_keys(NULL), known_data(NULL), has_known(false) {}
+
+	//min and max of A known already (e.g. from the cache zone maps), so the device skips the summary pass
+	void setKnownSummary(DataView A, const Summary& summary)
+	{
+		known_data = A.data();
+		known = summary;
+		has_known = true;
+	}
+
+	BackendKind kind() const { return BACKEND_OPENCL; }
+	Summary summary(DataView A) { return engine.summary(dataset(A)); }
+	mytype min(DataView A) { return engine.min(dataset(A)); }
+	mytype max(DataView A) { return engine.max(dataset(A)); }
+	double mean(DataView A) { return engine.mean(dataset(A)); }
+	Moments moments(DataView A) { return engine.moments(dataset(A)); }
+	vector<double> percentiles(DataView A, const vector<double>& ps) { return engine.percentiles(dataset(A), ps); }
+	Histogram histogram(DataView A, const BinLayout& layout) { return engine.histogram(dataset(A), layout); }
+	Histogram histogram(DataView A, int nr_bins) { return engine.histogram(dataset(A), nr_bins); }
+
+	vector<Summary> summaryByKey(DataView A, const cl_uchar* keys, int nr_keys)
+	{
+		int id = dataset(A);
+		if (keys != attached_keys) {
+			engine.setKeys(id, keys, true);
+			attached_keys = keys;
+		}
+		return engine.summaryByKey(id, nr_keys);
+	}
+
+private:
+	//id of A in the engine, wrapped in place so the values have to stay valid while the backend is used
+	int dataset(DataView A)
+	{
+		if ((id < 0) || (A.data() != data) || (A.size() != nr_elements)) {
+			bool use_known = has_known && (A.data() == known_data);
+			id = engine.addDataset(A, true, use_known ? &known : NULL);
+			data = A.data();
+			nr_elements = A.size();
+			attached_keys = NULL;
+		}
+		return id;
+	}
+
+	StatsEngine& engine;
+	int id; //dataset on the device, -1 before the first call
+	const mytype* data;
+	size_t nr_elements;
+	const cl_uchar* attached_keys; //attached to the dataset, NULL for none
+	const mytype* known_data;
+	Summary known;
+	bool has_known;
+};
+
+//threads and SIMD on the host, needs no device
+class NativeBackend : public StatsBackend {
+public:
+	BackendKind kind() const { return BACKEND_NATIVE; }
+	Summary summary(DataView A) { return nativeSummary(A); }
+	mytype min(DataView A) { return nativeMin(A); }
+	mytype max(DataView A) { return nativeMax(A); }
+	double mean(DataView A) { return nativeMean(A); }
+	Moments moments(DataView A) { return nativeMoments(A); }
+	vector<double> percentiles(DataView A, const vector<double>& ps) { return nativePercentiles(A, ps); }
+	vector<Summary> summaryByKey(DataView A, const cl_uchar* keys, int nr_keys) { return nativeSummaryByKey(A, keys, nr_keys); }
+	Histogram histogram(DataView A, const BinLayout& layout) { return nativeHistogram(A, layout); }
+	Histogram histogram(DataView A, int nr_bins) { return nativeHistogram(A, nr_bins); }
+};
+
+//picks the native or OpenCL backend per call by the size of the data, device is NULL when there is none
+//the choice is logged whenever it changes
+class AutoBackend : public StatsBackend {
+public:
+	AutoBackend(StatsBackend* device, BackendKind wanted = BACKEND_AUTO) : device(device), wanted(wanted), last(BACKEND_AUTO) {}
+
+	BackendKind kind() const { return BACKEND_AUTO; }
+	Summary summary(DataView A) { return pick(A).summary(A); }
+	mytype min(DataView A) { return pick(A).min(A); }
+	mytype max(DataView A) { return pick(A).max(A); }
+	double mean(DataView A) { return pick(A).mean(A); }
+	Moments moments(DataView A) { return pick(A).moments(A); }
+	vector<double> percentiles(DataView A, const vector<double>& ps) { return pick(A).percentiles(A, ps); }
+	vector<Summary> summaryByKey(DataView A, const cl_uchar* keys, int nr_keys) { return pick(A).summaryByKey(A, keys, nr_keys); }
+	Histogram histogram(DataView A, const BinLayout& layout) { return pick(A).histogram(A, layout); }
+	Histogram histogram(DataView A, int nr_bins) { return pick(A).histogram(A, nr_bins); }
+
+private:
+	StatsBackend& pick(DataView A)
+	{
+		std::ostringstream log;
+		BackendKind kind = chooseBackend(wanted, A.size(), device != NULL, log);
+		if (kind != last)
+			std::cout << log.str();
+		last = kind;
+		return (kind == BACKEND_NATIVE) ? (StatsBackend&)native : *device;
+	}
+
+	StatsBackend* device;
+	NativeBackend native;
+	BackendKind wanted;
+	BackendKind last;
+};
@@ -0,0 +1,527 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include "Functions.h"
+#include "StatsEngine.h"
+#include "NativeStats.h"
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+//statistics a batch query can ask for
+enum BatchStatistic {
+	BATCH_MIN, //min, max, sum, count and mean all come from one summary pass
+	BATCH_MAX,
+	BATCH_SUM,
+	BATCH_COUNT,
+	BATCH_MEAN,
+	BATCH_VARIANCE, //variance, stddev, skewness and kurtosis all come from one moments pass
+	BATCH_STDDEV,
+	BATCH_SKEWNESS,
+	BATCH_KURTOSIS,
+	BATCH_HISTOGRAM
+};
+
+const char* batchStatisticName(BatchStatistic statistic)
+{
+	static const char* names[] = { "min", "max", "sum", "count", "mean", "variance", "stddev", "skewness", "kurtosis", "histogram" };
+	return names[statistic];
+}
+
+//subset of every value, subsets 1 to 12 are the months
+#define BATCH_ALL 0
+#define BATCH_SUBSETS 13
+
+//one line of a query list: <subset> <statistic> [bins [min max]]
+//  subset     all, or month=1 to month=12
+//  statistic  min, max, sum, count, mean, variance, stddev, skewness, kurtosis or histogram
+//  bins       histogram only, equal width bins between min and max, or between the subset's rounded min and max when not given
+struct BatchQuery {
+	string text;
+	int subset;
+	BatchStatistic statistic;
+	int nr_bins;
+	bool has_range;
+	float range_min;
+	float range_max;
+	string error; //why the line could not be parsed, empty when it was
+};
+
+//a whole token as a number, false if any of it is not
+bool parseBatchNumber(const string& token, double& value)
+{
+	char* end = NULL;
+	value = strtod(token.c_str(), &end);
+	return !token.empty() && (*end == '\0');
+}
+
+BatchQuery parseBatchQuery(const string& text)
+{
+	BatchQuery query;
+	query.text = text;
+	query.subset = BATCH_ALL;
+	query.statistic = BATCH_MIN;
+	query.nr_bins = 0;
+	query.has_range = false;
+	query.range_min = query.range_max = 0;
+
+	vector<string> words;
+	istringstream tokens(text);
+	string word;
+	while (tokens >> word)
+		words.push_back(word);
+	if (words.size() < 2) {
+		query.error = "expected a subset and a statistic";
+		return query;
+	}
+
+	int month = 0;
+	char rest = 0;
+	if (words[0] == "all")
+		query.subset = BATCH_ALL;
+	else if ((sscanf(words[0].c_str(), "month=%d%c", &month, &rest) == 1) && (month >= 1) && (month <= 12))
+		query.subset = month;
+	else {
+		query.error = "subset must be all or month=1 to month=12";
+		return query;
+	}
+
+	bool known = false;
+	for (int s = BATCH_MIN; s <= BATCH_HISTOGRAM; s++) {
+		if (words[1] == batchStatisticName((BatchStatistic)s)) {
+			query.statistic = (BatchStatistic)s;
+			known = true;
+		}
+	}
+	if (!known) {
+		query.error = "unknown statistic";
+		return query;
+	}
+
+	double bins = 0, lo = 0, hi = 0;
+	if (query.statistic != BATCH_HISTOGRAM) {
+		if (words.size() != 2)
+			query.error = "only histogram takes arguments";
+	}
+	else if ((words.size() < 3) || !parseBatchNumber(words[2], bins) || (bins < 1) || (bins != floor(bins))) {
+		query.error = "histogram needs a whole number of bins above 0";
+	}
+	else if (words.size() == 5) {
+		if (!parseBatchNumber(words[3], lo) || !parseBatchNumber(words[4], hi) || !(lo < hi))
+			query.error = "histogram range needs a min below its max";
+		query.has_range = true;
+		query.range_min = (float)lo;
+		query.range_max = (float)hi;
+	}
+	else if (words.size() != 3) {
+		query.error = "histogram takes bins, or bins min max";
+	}
+	query.nr_bins = (int)bins;
+	return query;
+}
+
+//every query in a list, one per line, blank lines and lines starting with # are skipped
+vector<BatchQuery> readBatchQueries(std::istream& in)
+{
+	vector<BatchQuery> queries;
+	string line;
+	while (getline(in, line)) {
+		size_t first = line.find_first_not_of(" \t\r");
+		if ((first == string::npos) || (line[first] == '#'))
+			continue;
+		size_t last = line.find_last_not_of(" \t\r");
+		queries.push_back(parseBatchQuery(line.substr(first, last - first + 1)));
+	}
+	return queries;
+}
+
+//answer to one query, value for the single number statistics and histogram for histograms
+struct BatchResult {
+	double value;
+	Histogram histogram;
+	string error;
+};
+
+//text as a JSON string, quotes and control characters escaped
+string jsonString(const string& text)
+{
+	stringstream out;
+	out << '"';
+	for (size_t i = 0; i < text.size(); i++) {
+		unsigned char c = (unsigned char)text[i];
+		if ((c == '"') || (c == '\\'))
+			out << '\\' << c;
+		else if (c < 0x20)
+			out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+		else
+			out << c;
+	}
+	out << '"';
+	return out.str();
+}
+
+//a number as JSON, which has no NaN or infinity so those become null (e.g. the mean of an empty month)
+string jsonNumber(double value)
+{
+	if (!std::isfinite(value))
+		return "null";
+	stringstream out;
+	out << std::setprecision(10) << value;
+	return out.str();
+}
+
+//one JSON object per query on its own line (JSON lines), in the order the queries were given
+string batchJson(const vector<BatchQuery>& queries, const vector<BatchResult>& results)
+{
+	stringstream out;
+	for (size_t i = 0; i < queries.size(); i++) {
+		const BatchQuery& q = queries[i];
+		const BatchResult& r = results[i];
+		out << "{\"query\": " << jsonString(q.text);
+		if (!r.error.empty()) {
+			out << ", \"error\": " << jsonString(r.error) << "}" << std::endl;
+			continue;
+		}
+		out << ", \"subset\": \"" << (q.subset == BATCH_ALL ? string("all") : "month=" + std::to_string(q.subset))
+			<< "\", \"statistic\": \"" << batchStatisticName(q.statistic) << "\"";
+		if (q.statistic == BATCH_HISTOGRAM) {
+			out << ", \"edges\": [";
+			for (size_t b = 0; b < r.histogram.edges.size(); b++)
+				out << (b ? ", " : "") << jsonNumber(r.histogram.edges[b]);
+			out << "], \"counts\": [";
+			for (size_t b = 0; b < r.histogram.counts.size(); b++)
+				out << (b ? ", " : "") << r.histogram.counts[b];
+			out << "], \"underflow\": " << r.histogram.underflow << ", \"overflow\": " << r.histogram.overflow;
+		}
+		else {
+			out << ", \"value\": " << jsonNumber(r.value);
+		}
+		out << "}" << std::endl;
+	}
+	return out.str();
+}
+
+//answers a list of queries over one dataset with a single wait for the device at the end
+//the queries are planned together first: each subset is uploaded once however many queries use it, queries that need the
+//same kind of reduction over the same subset share one pass (min/max/sum/count/mean the summary, the shape statistics the moments),
+//the summaries of every month come from one keyed pass over the full data, and equal histograms are only counted once
+//everything is then enqueued without blocking, each kernel waiting on the events of the uploads it reads
+class BatchRunner {
+public:
+	//kernels come from the engine's program, the engine's queue runs the batch
+	BatchRunner(StatsEngine& engine) : engine(engine), nr_uploads(0), nr_passes(0)
+	{
+		cl::Program& program = engine.getProgram();
+		kernel_summary = cl::Kernel(program, "reduce_summary");
+		kernel_summary_partials = cl::Kernel(program, "reduce_summary_partials");
+		kernel_summary_by_key = cl::Kernel(program, "reduce_summary_by_key");
+		kernel_moments = cl::Kernel(program, "reduce_moments");
+		kernel_moments_partials = cl::Kernel(program, "reduce_moments_partials");
+		kernel_hist = cl::Kernel(program, "hist_atomic");
+		kernel_hist_local = cl::Kernel(program, "hist_local");
+	}
+
+	//one result per query, in the same order, months holds the month (1-12) of every value in A
+	//known_summary (e.g. from the cache zone maps) gives the range of histograms over all the data, otherwise the host finds it
+	vector<BatchResult> run(const vector<BatchQuery>& queries, DataView A, const cl_uchar* months, const Summary* known_summary = NULL)
+	{
+		cl::Context& context = engine.getContext();
+		cl::CommandQueue& queue = engine.getQueue();
+		cl::Device device = engine.getDevice();
+		size_t local_size = engine.getLocalSize();
+		size_t compute_units = engine.getComputeUnits();
+		nr_uploads = nr_passes = 0;
+		keep_alive.clear();
+
+		//what every subset needs, worked out before anything is enqueued
+		vector<SubsetPlan> subsets(BATCH_SUBSETS);
+		vector<HistogramPlan> histograms;
+		vector<int> histogram_of(queries.size(), -1);
+		bool keyed = false; //month summaries, all from one pass
+		for (size_t i = 0; i < queries.size(); i++) {
+			const BatchQuery& q = queries[i];
+			if (!q.error.empty())
+				continue;
+			SubsetPlan& subset = subsets[q.subset];
+			if (q.statistic == BATCH_HISTOGRAM) {
+				histogram_of[i] = findHistogram(histograms, q);
+				subset.histograms = true;
+			}
+			else if (q.statistic >= BATCH_VARIANCE)
+				subset.moments = true;
+			else if (q.subset == BATCH_ALL)
+				subset.summary = true;
+			else
+				keyed = true;
+		}
+
+		//months with moments or histograms get their own copy of their values, split out in one pass that also finds their ranges
+		bool split = false;
+		for (int m = 1; m < BATCH_SUBSETS; m++)
+			split = split || subsets[m].moments || subsets[m].histograms;
+		if (split) {
+			for (size_t i = 0; i < A.size(); i++) {
+				int m = months[i];
+				if ((m >= 1) && (m < BATCH_SUBSETS) && (subsets[m].moments || subsets[m].histograms)) {
+					SubsetPlan& subset = subsets[m];
+					subset.values.push_back(A[i]);
+					subset.range.min = std::min(subset.range.min, A[i]);
+					subset.range.max = std::max(subset.range.max, A[i]);
+				}
+			}
+			for (int m = 1; m < BATCH_SUBSETS; m++)
+				subsets[m].size = subsets[m].values.size();
+		}
+		subsets[BATCH_ALL].size = A.size();
+		if (subsets[BATCH_ALL].histograms) {
+			if (known_summary)
+				subsets[BATCH_ALL].range = *known_summary;
+			else {
+				NativeSummary s = nativeSummaryOf(A);
+				subsets[BATCH_ALL].range.min = s.min;
+				subsets[BATCH_ALL].range.max = s.max;
+			}
+		}
+
+		//bins of every histogram, the same ones StatsEngine::histogram would use when no range is given
+		for (size_t h = 0; h < histograms.size(); h++) {
+			HistogramPlan& plan = histograms[h];
+			const SubsetPlan& subset = subsets[plan.subset];
+			plan.empty = !subset.size;
+			if (plan.has_range)
+				plan.layout = uniformBins(plan.range_min, plan.range_max, plan.nr_bins);
+			else if (!plan.empty)
+				plan.layout = uniformBins(floor(subset.range.min), ceil(subset.range.max) + 1, plan.nr_bins);
+		}
+
+		//uploads, the full data is shared by its own queries and the keyed pass
+		vector<cl::Event> all_ready;
+		if ((subsets[BATCH_ALL].size) && (subsets[BATCH_ALL].summary || subsets[BATCH_ALL].moments || subsets[BATCH_ALL].histograms || keyed))
+			subsets[BATCH_ALL].buffer = upload(context, queue, device, A.data(), A.size() * sizeof(mytype), subsets[BATCH_ALL].ready);
+		for (int m = 1; m < BATCH_SUBSETS; m++)
+			if (subsets[m].size)
+				subsets[m].buffer = upload(context, queue, device, &subsets[m].values[0], subsets[m].size * sizeof(mytype), subsets[m].ready);
+
+		//month summaries, nr_keyed_groups partials for every month read back and folded on the host afterwards
+		size_t nr_keyed_groups = std::max(std::min(groupCount(A.size(), local_size), compute_units * 8), (size_t)1);
+		vector<Summary> keyed_partials;
+		if (keyed && A.size()) {
+			vector<cl::Event> keyed_ready = subsets[BATCH_ALL].ready;
+			cl::Buffer buffer_keys = upload(context, queue, device, months, A.size() * sizeof(cl_uchar), keyed_ready);
+			cl::Buffer buffer_partials(context, CL_MEM_READ_WRITE, nr_keyed_groups * (BATCH_SUBSETS - 1) * sizeof(Summary));
+			enqueueSummaryByKey(queue, kernel_summary_by_key, local_size, nr_keyed_groups, subsets[BATCH_ALL].buffer, buffer_keys, A.size(),
+				BATCH_SUBSETS - 1, buffer_partials, &keyed_ready);
+			keyed_partials.resize(nr_keyed_groups * (BATCH_SUBSETS - 1));
+			queue.enqueueReadBuffer(buffer_partials, CL_FALSE, 0, keyed_partials.size() * sizeof(Summary), &keyed_partials[0], NULL,
+				profileEvent("read partials", keyed_partials.size() * sizeof(Summary)));
+			keep_alive.push_back(buffer_keys);
+			keep_alive.push_back(buffer_partials);
+			nr_passes++;
+		}
+
+		//one summary and one moments pass per subset at most, each with partial buffers of its own
+		for (int s = 0; s < BATCH_SUBSETS; s++) {
+			SubsetPlan& subset = subsets[s];
+			if (!subset.size)
+				continue;
+			if (subset.summary) {
+				cl::Buffer result = enqueuePartials<Summary>(context, queue, kernel_summary, kernel_summary_partials, local_size, subset, 1);
+				queue.enqueueReadBuffer(result, CL_FALSE, 0, sizeof(Summary), &subset.summary_result, NULL, profileEvent("read result", sizeof(Summary)));
+			}
+			if (subset.moments) {
+				size_t items = itemsPerWorkItem(engine.getReduceConfig(), subset.size, local_size, compute_units);
+				cl::Buffer result = enqueuePartials<Moments>(context, queue, kernel_moments, kernel_moments_partials, local_size, subset, items);
+				queue.enqueueReadBuffer(result, CL_FALSE, 0, sizeof(Moments), &subset.moments_result, NULL, profileEvent("read result", sizeof(Moments)));
+			}
+		}
+
+		//histograms, each cleared and counted after its subset is on the device
+		for (size_t h = 0; h < histograms.size(); h++) {
+			HistogramPlan& plan = histograms[h];
+			if (plan.empty)
+				continue;
+			SubsetPlan& subset = subsets[plan.subset];
+			size_t nr_counters = histogramCounters(plan.layout);
+			plan.counts.assign(nr_counters, 0);
+			plan.buffer_H = cl::Buffer(context, CL_MEM_READ_WRITE, nr_counters * sizeof(int));
+			plan.buffer_edges = edgesBuffer(context, device, plan.layout);
+
+			vector<cl::Event> ready = subset.ready;
+			cl::Event cleared;
+			queue.enqueueFillBuffer(plan.buffer_H, 0, 0, nr_counters * sizeof(int), NULL, &cleared);
+			profiled(cleared, "fill", nr_counters * sizeof(int));
+			ready.push_back(cleared);
+
+			int copies = (engine.getHistogramMethod() == HIST_GLOBAL) ? 0 : histogramCopies(engine.getLocalMemSize(), plan.layout, local_size);
+			if (copies)
+				enqueueHistogramLocal(queue, kernel_hist_local, local_size, compute_units * 16, subset.buffer, subset.size, plan.layout, copies,
+					plan.buffer_edges, plan.buffer_H, &ready);
+			else
+				enqueueHistogram(queue, kernel_hist, local_size, subset.buffer, subset.size, plan.layout, plan.buffer_edges, plan.buffer_H, &ready);
+
+			queue.enqueueReadBuffer(plan.buffer_H, CL_FALSE, 0, nr_counters * sizeof(int), &plan.counts[0], NULL,
+				profileEvent("read histogram", nr_counters * sizeof(int)));
+			nr_passes++;
+		}
+
+		//the only wait of the whole batch
+		queue.finish();
+		keep_alive.clear();
+
+		vector<Summary> month_summaries(BATCH_SUBSETS - 1, emptySummary());
+		if (!keyed_partials.empty())
+			month_summaries = mergeKeyedSummaries(keyed_partials, nr_keyed_groups, BATCH_SUBSETS - 1);
+
+		vector<BatchResult> results(queries.size());
+		for (size_t i = 0; i < queries.size(); i++) {
+			const BatchQuery& q = queries[i];
+			BatchResult& r = results[i];
+			r.value = NAN;
+			if (!q.error.empty()) {
+				r.error = q.error;
+				continue;
+			}
+
+			const SubsetPlan& subset = subsets[q.subset];
+			const Summary& summary = (q.subset == BATCH_ALL) ? subset.summary_result : month_summaries[q.subset - 1];
+			const Moments& moments = subset.moments_result;
+			bool any = summary.count > 0;
+			switch (q.statistic) {
+			case BATCH_MIN: r.value = any ? summary.min : NAN; break;
+			case BATCH_MAX: r.value = any ? summary.max : NAN; break;
+			case BATCH_SUM: r.value = summary.sum; break;
+			case BATCH_COUNT: r.value = summary.count; break;
+			case BATCH_MEAN: r.value = any ? summary.mean() : NAN; break;
+			case BATCH_VARIANCE: r.value = moments.n ? moments.variance() : NAN; break;
+			case BATCH_STDDEV: r.value = moments.n ? moments.stdDev() : NAN; break;
+			case BATCH_SKEWNESS: r.value = moments.n ? moments.skewness() : NAN; break;
+			case BATCH_KURTOSIS: r.value = moments.n ? moments.kurtosis() : NAN; break;
+			case BATCH_HISTOGRAM: {
+				const HistogramPlan& plan = histograms[histogram_of[i]];
+				if (plan.empty && !plan.has_range)
+					r.error = "subset has no values to take the bin range from";
+				else if (plan.empty)
+					r.histogram = makeHistogram(vector<int>(histogramCounters(plan.layout), 0), plan.layout);
+				else
+					r.histogram = makeHistogram(plan.counts, plan.layout);
+				break;
+			}
+			}
+		}
+		return results;
+	}
+
+	//uploads and kernel passes the last batch was planned into, to compare with the number of queries
+	size_t uploads() const { return nr_uploads; }
+	size_t passes() const { return nr_passes; }
+
+private:
+	//what one subset needs and, once run, what came back
+	struct SubsetPlan {
+		bool summary, moments, histograms;
+		vector<mytype> values; //host copy of a month's values, kept until the batch is done as the upload reads it
+		size_t size;
+		Summary range; //min and max for the histogram bins
+		cl::Buffer buffer;
+		vector<cl::Event> ready; //upload of buffer
+		Summary summary_result;
+		Moments moments_result;
+
+		SubsetPlan() : summary(false), moments(false), histograms(false), size(0), range(emptySummary()), summary_result(emptySummary())
+		{
+			Moments none = { 0, 0, 0, 0, 0 };
+			moments_result = none;
+		}
+	};
+
+	//one histogram, shared by every query asking for the same subset, bins and range
+	struct HistogramPlan {
+		int subset;
+		int nr_bins;
+		bool has_range;
+		float range_min, range_max;
+		bool empty; //subset has no values
+		BinLayout layout;
+		cl::Buffer buffer_H, buffer_edges;
+		vector<int> counts;
+	};
+
+	//index of the histogram plan for a query, added if no earlier query asked for the same one
+	static int findHistogram(vector<HistogramPlan>& histograms, const BatchQuery& q)
+	{
+		for (size_t h = 0; h < histograms.size(); h++) {
+			const HistogramPlan& p = histograms[h];
+			if ((p.subset == q.subset) && (p.nr_bins == q.nr_bins) && (p.has_range == q.has_range)
+				&& (!q.has_range || ((p.range_min == q.range_min) && (p.range_max == q.range_max))))
+				return (int)h;
+		}
+		HistogramPlan plan;
+		plan.subset = q.subset;
+		plan.nr_bins = q.nr_bins;
+		plan.has_range = q.has_range;
+		plan.range_min = q.range_min;
+		plan.range_max = q.range_max;
+		plan.empty = false;
+		histograms.push_back(plan);
+		return (int)histograms.size() - 1;
+	}
+
+	//the profiler times a command through an event of its own, so it is given a copy of the one the batch waits on
+	static void profiled(const cl::Event& event, const string& stage, size_t bytes)
+	{
+		cl::Event* record = profileEvent(stage, bytes);
+		if (record)
+			*record = event;
+	}
+
+	//device copy of host memory, written without blocking (the write event goes in ready) or read in place where the device shares host memory
+	//data has to stay valid until the batch is done
+	cl::Buffer upload(cl::Context& context, cl::CommandQueue& queue, const cl::Device& device, const void* data, size_t bytes, vector<cl::Event>& ready)
+	{
+		if (sharesHostMemory(device))
+			return cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, bytes, (void*)data);
+
+		cl::Buffer buffer(context, CL_MEM_READ_ONLY, bytes);
+		cl::Event written;
+		queue.enqueueWriteBuffer(buffer, CL_FALSE, 0, bytes, data, NULL, &written);
+		profiled(written, "write", bytes);
+		ready.push_back(written);
+		nr_uploads++;
+		return buffer;
+	}
+
+	//enqueues one reduction of a subset with partial buffers of its own, so reductions in flight never share them
+	template <typename T>
+	cl::Buffer enqueuePartials(cl::Context& context, cl::CommandQueue& queue, cl::Kernel& kernel_values, cl::Kernel& kernel_partials, size_t local_size,
+		const SubsetPlan& subset, size_t items_per_work_item)
+	{
+		size_t nr_groups = groupCount(subset.size, local_size);
+		cl::Buffer buffer_B(context, CL_MEM_READ_WRITE, nr_groups * sizeof(T));
+		cl::Buffer buffer_C(context, CL_MEM_READ_WRITE, nr_groups * sizeof(T));
+		keep_alive.push_back(buffer_B);
+		keep_alive.push_back(buffer_C);
+		nr_passes++;
+		return enqueueReducePartials<T>(queue, kernel_values, kernel_partials, local_size, subset.buffer, subset.size, buffer_B, buffer_C,
+			items_per_work_item, &subset.ready);
+	}
+
+	StatsEngine& engine;
+	cl::Kernel kernel_summary, kernel_summary_partials, kernel_summary_by_key;
+	cl::Kernel kernel_moments, kernel_moments_partials;
+	cl::Kernel kernel_hist, kernel_hist_local;
+	vector<cl::Buffer> keep_alive; //buffers of commands still in flight
+	size_t nr_uploads;
+	size_t nr_passes;
+};
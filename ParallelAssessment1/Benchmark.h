@@ -0,0 +1,206 @@
+#pragma once
+
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+#include "Functions.h"
+#include "StatsEngine.h"
+#include "DataLoader.h"
+
+//median and 99th percentile wall time of a query in milliseconds
+struct Latency {
+	double median_ms;
+	double p99_ms;
+};
+
+//runs a query a number of times and times each run
+template <typename F>
+Latency latencyMs(int trials, F query)
+{
+	vector<double> times;
+	for (int t = 0; t < std::max(trials, 1); t++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		query();
+		auto end = std::chrono::high_resolution_clock::now();
+		times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	std::sort(times.begin(), times.end());
+	Latency latency = { times[times.size() / 2], times[std::min(times.size() - 1, (size_t)ceil(0.99 * times.size()) - 1)] };
+	return latency;
+}
+
+//median wall time in milliseconds of running a query a number of times
+template <typename F>
+double medianMs(int trials, F query)
+{
+	return latencyMs(trials, query).median_ms;
+}
+
+//times every reduction kernel family and elements per work item on dataset id (a device copy of A),
+//and checks each result against the sequential version
+void benchmarkReduceVariants(StatsEngine& engine, int id, DataView A, int trials = 10)
+{
+	ReduceConfig saved = engine.getReduceConfig();
+
+	//sequential results to check against
+	double cpu_mean = accurateMean(A);
+	mytype cpu_min = *std::min_element(A.begin(), A.end());
+	mytype cpu_max = *std::max_element(A.begin(), A.end());
+
+	const size_t items[] = { 1, 4, 16, 64, 0 }; //0 is the automatic choice
+	double gb = (double)A.size() * sizeof(mytype) / 1e9;
+
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << "Reduction Benchmark, " << A.size() << " elements, median of " << trials << " runs" << std::endl;
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << std::left << std::setw(13) << "variant" << std::setw(7) << "items" << std::setw(8) << "op"
+		<< std::setw(12) << "time [ms]" << std::setw(10) << "GB/s" << "check" << std::endl;
+
+	for (int variant = REDUCE_INTERLEAVED; variant <= REDUCE_UNROLLED; variant++) {
+		if ((variant == REDUCE_UNROLLED) && !engine.supportsUnrolled()) {
+			std::cout << std::setw(13) << "unrolled" << "skipped, device does not run 32 work items in lockstep" << std::endl;
+			continue;
+		}
+
+		for (size_t n : items) {
+			if ((variant == REDUCE_INTERLEAVED) && (n != 1))
+				continue; //interleaved kernels only take one element per work item
+
+			ReduceConfig config = { (ReduceVariant)variant, n };
+			engine.setReduceConfig(config);
+
+			double min_val = 0, max_val = 0, mean_val = 0;
+			double min_ms = medianMs(trials, [&]() { min_val = engine.min(id); });
+			double max_ms = medianMs(trials, [&]() { max_val = engine.max(id); });
+			double mean_ms = medianMs(trials, [&]() { mean_val = (double)engine.sum(id) / A.size(); });
+
+			//float sums drift from the double sequential sum so allow a small relative error
+			bool mean_ok = fabs(mean_val - cpu_mean) <= 1e-3 * std::max(1.0, fabs(cpu_mean));
+
+			string label = n ? std::to_string(n) : "auto";
+			std::cout << std::setw(13) << reduceVariantName((ReduceVariant)variant) << std::setw(7) << label << std::setw(8) << "min"
+				<< std::setw(12) << min_ms << std::setw(10) << gb / (min_ms / 1e3) << ((min_val == cpu_min) ? "ok" : "WRONG") << std::endl;
+			std::cout << std::setw(13) << "" << std::setw(7) << "" << std::setw(8) << "max"
+				<< std::setw(12) << max_ms << std::setw(10) << gb / (max_ms / 1e3) << ((max_val == cpu_max) ? "ok" : "WRONG") << std::endl;
+			std::cout << std::setw(13) << "" << std::setw(7) << "" << std::setw(8) << "mean"
+				<< std::setw(12) << mean_ms << std::setw(10) << gb / (mean_ms / 1e3) << (mean_ok ? "ok" : "WRONG") << std::endl;
+		}
+	}
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << std::right;
+
+	engine.setReduceConfig(saved);
+}
+
+//times the mean in every precision mode and checks it against accurateMean within the tolerance documented on MeanPrecision
+void benchmarkMeanPrecision(StatsEngine& engine, int id, DataView A, int trials = 10)
+{
+	MeanPrecision saved = engine.getMeanPrecision();
+
+	double cpu_mean = accurateMean(A);
+	double scale = 0; //mean of the absolute values, the tolerances are relative to it
+	for (size_t i = 0; i < A.size(); i++)
+		scale += fabs(A[i]);
+	scale = std::max(scale / A.size(), 1e-30);
+
+	const char* names[] = { "float", "compensated", "double" };
+
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << "Mean Precision, accurateMean = " << std::setprecision(10) << cpu_mean << std::endl;
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << std::left << std::setw(13) << "precision" << std::setw(12) << "time [ms]" << std::setw(14) << "rel. error" << "check" << std::endl;
+
+	for (int p = PRECISION_FLOAT; p <= PRECISION_DOUBLE; p++) {
+		engine.setMeanPrecision((MeanPrecision)p);
+		if (engine.getMeanPrecision() != p) {
+			std::cout << std::setw(13) << names[p] << "skipped, not supported by this device" << std::endl;
+			continue;
+		}
+
+		double mean_val = 0;
+		double ms = medianMs(trials, [&]() { mean_val = engine.mean(id); });
+		double error = fabs(mean_val - cpu_mean) / scale;
+
+		double tolerance = meanTolerance((MeanPrecision)p);
+		string check = (tolerance < 0) ? "-" : ((error <= tolerance) ? "ok" : "OUTSIDE TOLERANCE");
+		std::cout << std::setw(13) << names[p] << std::setw(12) << ms << std::setw(14) << error << check << std::endl;
+	}
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << std::right << std::setprecision(6);
+
+	engine.setMeanPrecision(saved);
+}
+
+//true when two histograms have the same counts in every bin, underflow and overflow
+bool sameHistogram(const Histogram& a, const Histogram& b)
+{
+	return (a.counts == b.counts) && (a.underflow == b.underflow) && (a.overflow == b.overflow);
+}
+
+//times the global atomic and local sub-histogram kernels at a few bin counts and checks them against a sequential histogram
+void benchmarkHistogram(StatsEngine& engine, int id, DataView A, int trials = 10)
+{
+	HistogramMethod saved = engine.getHistogramMethod();
+
+	const int bins[] = { 10, 100, 10000 };
+	const HistogramMethod methods[] = { HIST_GLOBAL, HIST_LOCAL };
+	const char* names[] = { "auto", "global", "local" };
+	double gb = (double)A.size() * sizeof(mytype) / 1e9;
+
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << "Histogram Benchmark, " << A.size() << " elements, median of " << trials << " runs" << std::endl;
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << std::left << std::setw(8) << "bins" << std::setw(9) << "kernel" << std::setw(12) << "time [ms]" << std::setw(10) << "GB/s" << "check" << std::endl;
+
+	for (int nr_bins : bins) {
+		for (HistogramMethod method : methods) {
+			engine.setHistogramMethod(method);
+
+			Summary summary = engine.summary(id);
+			BinLayout layout = uniformBins(floor(summary.min), ceil(summary.max) + 1, nr_bins);
+
+			Histogram H;
+			double ms = medianMs(trials, [&]() { H = engine.histogram(id, layout); });
+
+			//sequential histogram with the same bins
+			Histogram expected = normalHist(A, layout);
+
+			std::cout << std::setw(8) << nr_bins << std::setw(9) << names[method] << std::setw(12) << ms << std::setw(10) << gb / (ms / 1e3)
+				<< (sameHistogram(H, expected) ? "ok" : "WRONG") << std::endl;
+		}
+	}
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << std::right;
+
+	engine.setHistogramMethod(saved);
+}
+
+//times the line by line loader against the memory mapped multithreaded one and checks they read the same rows
+void benchmarkLoader(const string& file_name, int trials = 3)
+{
+	TemperatureData baseline, fast;
+	if (!loadTemperatureFileStream(file_name, baseline) || !loadTemperatureFile(file_name, fast)) {
+		std::cout << "Loader benchmark skipped, could not open " << file_name << std::endl;
+		return;
+	}
+
+	ifstream file(file_name, ios::binary | ios::ate);
+	double mb = (double)file.tellg() / 1e6;
+
+	double stream_ms = medianMs(trials, [&]() { loadTemperatureFileStream(file_name, baseline); });
+	double fast_ms = medianMs(trials, [&]() { loadTemperatureFile(file_name, fast); });
+	bool same = (baseline.values == fast.values) && (baseline.months == fast.months);
+
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << "Loader Benchmark, " << mb << " MB, " << fast.values.size() << " rows, median of " << trials << " runs" << std::endl;
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << std::left << std::setw(13) << "loader" << std::setw(12) << "time [ms]" << std::setw(10) << "MB/s" << "check" << std::endl;
+	std::cout << std::setw(13) << "istringstream" << std::setw(12) << stream_ms << std::setw(10) << mb / (stream_ms / 1e3) << "-" << std::endl;
+	std::cout << std::setw(13) << "mapped" << std::setw(12) << fast_ms << std::setw(10) << mb / (fast_ms / 1e3) << (same ? "ok" : "DIFFERENT") << std::endl;
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << std::right;
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "DataLoader.h"
+#include "Functions.h"
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+//binary columnar copy of a parsed temperature file, written after the first text load and mapped on later runs
+//layout: header | values column (float) | months column (uint8) | zone maps, every section starts on a page boundary
+//so the values column can back a CL_MEM_USE_HOST_PTR buffer without a copy
+
+#define CACHE_MAGIC "TEMPCOL"
+#define CACHE_VERSION 1
+#define CACHE_ALIGNMENT 4096
+#define CACHE_BLOCK_ROWS 65536
+
+//min/max/sum of one block of CACHE_BLOCK_ROWS rows, the last block may be shorter
+struct ZoneMap {
+	cl_float min;
+	cl_float max;
+	double sum;
+	cl_uint count;
+	cl_uint padding;
+};
+
+struct CacheHeader {
+	char magic[8];
+	cl_uint version;
+	cl_uint block_rows;
+	cl_ulong nr_rows;
+	cl_ulong nr_blocks;
+	cl_ulong source_size; //size and modification time of the text file the cache was made from
+	cl_ulong source_time;
+	cl_ulong values_offset; //byte offsets of the columns from the start of the file
+	cl_ulong months_offset;
+	cl_ulong zones_offset; //0 when there are no zone maps
+};
+
+//size and modification time of a file, false if it does not exist
+inline bool fileStamp(const string& file_name, cl_ulong& size, cl_ulong& time)
+{
+	struct stat st;
+	if (stat(file_name.c_str(), &st) != 0)
+		return false;
+	size = (cl_ulong)st.st_size;
+	time = (cl_ulong)st.st_mtime;
+	return true;
+}
+
+inline cl_ulong alignUp(cl_ulong offset, cl_ulong alignment) { return (offset + alignment - 1) / alignment * alignment; }
+
+//the cache lives next to the text file
+inline string cacheFileName(const string& source_file) { return source_file + ".tcol"; }
+
+//per block min/max/sum of the values column
+vector<ZoneMap> buildZoneMaps(const vector<mytype>& values, size_t block_rows = CACHE_BLOCK_ROWS)
+{
+	vector<ZoneMap> zones((values.size() + block_rows - 1) / block_rows);
+	for (size_t b = 0; b < zones.size(); b++) {
+		size_t begin = b * block_rows, end = std::min(begin + block_rows, values.size());
+		ZoneMap zone = { INFINITY, -INFINITY, 0, (cl_uint)(end - begin), 0 };
+		for (size_t i = begin; i < end; i++) {
+			zone.min = std::min(zone.min, values[i]);
+			zone.max = std::max(zone.max, values[i]);
+			zone.sum += values[i];
+		}
+		zones[b] = zone;
+	}
+	return zones;
+}
+
+//pad the stream with zeros up to offset
+inline void padTo(ofstream& file, cl_ulong offset)
+{
+	static const char zeros[CACHE_ALIGNMENT] = {};
+	cl_ulong at = (cl_ulong)file.tellp();
+	if (offset > at)
+		file.write(zeros, (std::streamsize)(offset - at));
+}
+
+//writes data as a cache of source_file, written to a temporary file first so a crash never leaves half a cache behind
+//returns false if the cache could not be written, the text file still works in that case
+bool writeTemperatureCache(const string& cache_file, const string& source_file, const TemperatureData& data)
+{
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.block_rows = CACHE_BLOCK_ROWS;
+	header.nr_rows = data.values.size();
+	if (!fileStamp(source_file, header.source_size, header.source_time))
+		return false;
+
+	vector<ZoneMap> zones = buildZoneMaps(data.values);
+	header.nr_blocks = zones.size();
+	header.values_offset = alignUp(sizeof(CacheHeader), CACHE_ALIGNMENT);
+	header.months_offset = alignUp(header.values_offset + header.nr_rows * sizeof(mytype), CACHE_ALIGNMENT);
+	header.zones_offset = alignUp(header.months_offset + header.nr_rows * sizeof(cl_uchar), CACHE_ALIGNMENT);
+
+	string temp_file = cache_file + ".tmp";
+	{
+		ofstream file(temp_file, ios::binary | ios::trunc);
+		if (file.fail())
+			return false;
+
+		file.write((const char*)&header, sizeof(header));
+		padTo(file, header.values_offset);
+		if (header.nr_rows)
+			file.write((const char*)&data.values[0], header.nr_rows * sizeof(mytype));
+		padTo(file, header.months_offset);
+		if (header.nr_rows)
+			file.write((const char*)&data.months[0], header.nr_rows * sizeof(cl_uchar));
+		padTo(file, header.zones_offset);
+		if (!zones.empty())
+			file.write((const char*)&zones[0], zones.size() * sizeof(ZoneMap));
+
+		if (file.fail()) {
+			file.close();
+			remove(temp_file.c_str());
+			return false;
+		}
+	}
+
+	remove(cache_file.c_str()); //rename does not replace an existing file on Windows
+	return rename(temp_file.c_str(), cache_file.c_str()) == 0;
+}
+
+//read only columns of a cache file, mapped so rows are only paged in when something reads them
+//when no cache could be written the columns are held in memory instead, so callers see the same thing either way
+class TemperatureCache {
+public:
+	TemperatureCache() : header(NULL) {}
+
+	//maps cache_file and checks it was made from the current source_file, false if it is missing, stale or damaged
+	bool open(const string& cache_file, const string& source_file)
+	{
+		close();
+		if (!file.open(cache_file, true) || (file.length() < sizeof(CacheHeader)))
+			return close();
+
+		header = (const CacheHeader*)file.begin();
+		if ((memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) || (header->version != CACHE_VERSION))
+			return close();
+
+		cl_ulong source_size, source_time;
+		if (fileStamp(source_file, source_size, source_time) && ((source_size != header->source_size) || (source_time != header->source_time)))
+			return close(); //text file changed since the cache was written
+
+		if ((header->months_offset + header->nr_rows * sizeof(cl_uchar) > file.length()) ||
+			(header->values_offset + header->nr_rows * sizeof(mytype) > file.length()) ||
+			(header->zones_offset && (header->zones_offset + header->nr_blocks * sizeof(ZoneMap) > file.length())))
+			return close(); //truncated
+
+		return true;
+	}
+
+	//keep already parsed columns in memory instead of a mapped file
+	void hold(TemperatureData& data)
+	{
+		close();
+		held.values.swap(data.values);
+		held.months.swap(data.months);
+		held_zones = buildZoneMaps(held.values);
+	}
+
+	bool close()
+	{
+		file.close();
+		header = NULL;
+		held = TemperatureData();
+		held_zones.clear();
+		return false;
+	}
+
+	bool isMapped() const { return header != NULL; }
+	size_t size() const { return header ? (size_t)header->nr_rows : held.values.size(); }
+
+	//page aligned when mapped, can be handed to a CL_MEM_USE_HOST_PTR buffer
+	const mytype* values() const { return header ? (const mytype*)(file.begin() + header->values_offset) : held.values.data(); }
+	DataView view() const { return DataView(values(), size()); }
+	const cl_uchar* months() const { return header ? (const cl_uchar*)(file.begin() + header->months_offset) : held.months.data(); }
+
+	size_t nrZones() const { return header ? (header->zones_offset ? (size_t)header->nr_blocks : 0) : held_zones.size(); }
+	size_t zoneRows() const { return header ? header->block_rows : CACHE_BLOCK_ROWS; }
+	const ZoneMap* zones() const { return header ? (const ZoneMap*)(file.begin() + header->zones_offset) : held_zones.data(); }
+
+	//copy of the columns, for code that still wants vectors
+	TemperatureData copy() const
+	{
+		TemperatureData data;
+		if (size()) {
+			data.values.assign(values(), values() + size());
+			data.months.assign(months(), months() + size());
+		}
+		return data;
+	}
+
+private:
+	MappedFile file;
+	const CacheHeader* header;
+	TemperatureData held;
+	vector<ZoneMap> held_zones;
+};
+
+//min, max, sum and count of the whole values column folded from the zone maps, no need to read the values
+//false if the cache has no zone maps
+bool zoneSummary(const TemperatureCache& cache, Summary& summary)
+{
+	if (!cache.nrZones() && cache.size())
+		return false;
+
+	float min = INFINITY, max = -INFINITY;
+	double sum = 0;
+	size_t count = 0;
+	const ZoneMap* zones = cache.zones();
+	for (size_t b = 0; b < cache.nrZones(); b++) {
+		min = std::min(min, zones[b].min);
+		max = std::max(max, zones[b].max);
+		sum += zones[b].sum;
+		count += zones[b].count;
+	}
+	summary.min = min;
+	summary.max = max;
+	summary.sum = (cl_float)sum;
+	summary.count = (cl_uint)count;
+	return true;
+}
+
+//opens the cache of source_file, parsing the text file and writing the cache first when there is no valid one
+//if the cache cannot be written the parsed columns are kept in memory, returns false only if the text file cannot be read
+bool loadTemperatureCached(const string& source_file, TemperatureCache& cache)
+{
+	string cache_file = cacheFileName(source_file);
+	if (cache.open(cache_file, source_file))
+		return true;
+
+	TemperatureData data;
+	if (!loadTemperatureFile(source_file, data))
+		return false;
+
+	if (writeTemperatureCache(cache_file, source_file, data) && cache.open(cache_file, source_file))
+		return true;
+
+	std::cerr << "Could not write the data cache " << cache_file << ", using the parsed data directly" << std::endl;
+	cache.hold(data);
+	return true;
+}
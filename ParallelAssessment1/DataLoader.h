@@ -0,0 +1,353 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+using namespace std;
+
+typedef float mytype;
+
+//parsed temperature file, one entry per row in file order (structure of arrays so values can go straight to the device)
+struct TemperatureData {
+	vector<mytype> values;
+	vector<cl_uchar> months; //1-12
+};
+
+//read only view of a whole file mapped into memory, the OS pages it in as it is read
+class MappedFile {
+public:
+	MappedFile() : data(NULL), size(0) {
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE; mapping = NULL;
+#else
+		fd = -1;
+#endif
+	}
+	~MappedFile() { close(); }
+
+	//false when the file cannot be opened or mapped
+	//a private copy lets the pages be written without touching the file, which CL_MEM_USE_HOST_PTR buffers may do
+	bool open(const string& file_name, bool private_copy = false)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER file_size;
+		GetFileSizeEx(file, &file_size);
+		size = (size_t)file_size.QuadPart;
+		if (!size)
+			return true; //nothing to map
+		mapping = CreateFileMappingA(file, NULL, private_copy ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+		if (!mapping)
+			return false;
+		data = (const char*)MapViewOfFile(mapping, private_copy ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+#else
+		fd = ::open(file_name.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		fstat(fd, &st);
+		size = (size_t)st.st_size;
+		if (!size)
+			return true; //nothing to map
+		void* p = mmap(NULL, size, private_copy ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+			return false;
+		madvise(p, size, MADV_SEQUENTIAL);
+		data = (const char*)p;
+#endif
+		return data != NULL;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		file = INVALID_HANDLE_VALUE; mapping = NULL;
+#else
+		if (data) munmap((void*)data, size);
+		if (fd >= 0) ::close(fd);
+		fd = -1;
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+	const char* begin() const { return data; }
+	const char* end() const { return data + size; }
+	size_t length() const { return size; }
+
+private:
+	MappedFile(const MappedFile&); //not copyable, owns the mapping
+	MappedFile& operator=(const MappedFile&);
+
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#else
+	int fd;
+#endif
+};
+
+inline bool isBlank(char c) { return (c == ' ') || (c == '\t') || (c == '\r'); }
+
+//skip spaces and tabs
+inline const char* skipBlanks(const char* p, const char* end)
+{
+	while ((p < end) && isBlank(*p))
+		p++;
+	return p;
+}
+
+//skip one whitespace separated column
+inline const char* skipToken(const char* p, const char* end)
+{
+	p = skipBlanks(p, end);
+	while ((p < end) && !isBlank(*p) && (*p != '\n'))
+		p++;
+	return p;
+}
+
+//reads a whole number, returns NULL if there are no digits
+inline const char* parseInt(const char* p, const char* end, int& out)
+{
+	p = skipBlanks(p, end);
+	bool negative = (p < end) && (*p == '-');
+	if (negative || ((p < end) && (*p == '+')))
+		p++;
+
+	const char* digits = p;
+	int value = 0;
+	while ((p < end) && (*p >= '0') && (*p <= '9'))
+		value = value * 10 + (*p++ - '0');
+	if (p == digits)
+		return NULL;
+
+	out = negative ? -value : value;
+	return p;
+}
+
+//reads a plain decimal number such as -3.25 or 1.5e2 without allocating or touching the locale, returns NULL if there are no digits
+//the digits are gathered into an integer and scaled once so the result is as close as a double allows before rounding to float
+inline const char* parseFloat(const char* p, const char* end, float& out)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+
+	p = skipBlanks(p, end);
+	bool negative = (p < end) && (*p == '-');
+	if (negative || ((p < end) && (*p == '+')))
+		p++;
+
+	uint64_t mantissa = 0;
+	int exponent = 0, nr_digits = 0;
+	while ((p < end) && (*p >= '0') && (*p <= '9')) {
+		if (mantissa < 100000000000000000ULL) mantissa = mantissa * 10 + (*p - '0');
+		else exponent++; //too many digits to keep, only the magnitude matters
+		p++; nr_digits++;
+	}
+	if ((p < end) && (*p == '.')) {
+		p++;
+		while ((p < end) && (*p >= '0') && (*p <= '9')) {
+			if (mantissa < 100000000000000000ULL) { mantissa = mantissa * 10 + (*p - '0'); exponent--; }
+			p++; nr_digits++;
+		}
+	}
+	if (!nr_digits)
+		return NULL;
+
+	if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+		int e;
+		const char* after = parseInt(p + 1, end, e);
+		if (after) { exponent += e; p = after; }
+	}
+
+	double value = (double)mantissa;
+	if ((exponent >= -18) && (exponent <= 18))
+		value = (exponent < 0) ? value / powers[-exponent] : value * powers[exponent];
+	else
+		value *= pow(10.0, exponent);
+
+	out = (float)(negative ? -value : value);
+	return p;
+}
+
+//reads the month (3rd column) and temperature (6th column) of one row, false if the row does not have them
+inline bool parseRow(const char* p, const char* end, float& val, int& monthID)
+{
+	p = skipToken(p, end);
+	p = skipToken(p, end);
+	p = parseInt(p, end, monthID);
+	if (!p)
+		return false;
+	p = skipToken(p, end);
+	p = skipToken(p, end);
+	return (parseFloat(p, end, val) != NULL) && (monthID >= 1) && (monthID <= 12);
+}
+
+//end of the line starting at p (the '\n' or end)
+inline const char* lineEnd(const char* p, const char* end)
+{
+	const char* nl = (const char*)memchr(p, '\n', end - p);
+	return nl ? nl : end;
+}
+
+//true if the line has anything other than blanks
+inline bool hasContent(const char* p, const char* line_end)
+{
+	return skipBlanks(p, line_end) < line_end;
+}
+
+//loads the whole temperature file with nr_threads threads (0 uses every core)
+//the mapped file is split at line boundaries, each thread counts its rows, the output is sized once
+//and each thread then parses its rows straight into its own part of the output
+//returns false if the file cannot be opened
+bool loadTemperatureFile(const string& file_name, TemperatureData& data, unsigned int nr_threads = 0)
+{
+	MappedFile file;
+	if (!file.open(file_name))
+		return false;
+
+	data.values.clear();
+	data.months.clear();
+	if (!file.length())
+		return true;
+
+	if (!nr_threads)
+		nr_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	nr_threads = (unsigned int)std::min<size_t>(nr_threads, file.length() / 4096 + 1); //no point splitting tiny files
+
+	//split points moved forward to the start of the next line so no row is cut in two
+	vector<const char*> starts(nr_threads + 1);
+	starts[0] = file.begin();
+	starts[nr_threads] = file.end();
+	for (unsigned int t = 1; t < nr_threads; t++) {
+		const char* p = file.begin() + (file.length() / nr_threads) * t;
+		p = std::max(p, starts[t - 1]);
+		const char* nl = lineEnd(p, file.end());
+		starts[t] = (nl < file.end()) ? nl + 1 : file.end();
+	}
+
+	//pass 1 - rows per part
+	vector<size_t> rows(nr_threads + 1, 0);
+	vector<std::thread> threads;
+	for (unsigned int t = 0; t < nr_threads; t++) {
+		threads.push_back(std::thread([&, t]() {
+			size_t count = 0;
+			for (const char* p = starts[t]; p < starts[t + 1];) {
+				const char* e = lineEnd(p, starts[t + 1]);
+				if (hasContent(p, e))
+					count++;
+				p = e + 1;
+			}
+			rows[t + 1] = count;
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+	threads.clear();
+
+	//offsets of each part in the output
+	for (unsigned int t = 1; t <= nr_threads; t++)
+		rows[t] += rows[t - 1];
+	data.values.resize(rows[nr_threads]);
+	data.months.resize(rows[nr_threads]);
+
+	//pass 2 - parse in place, rows that do not parse are marked with month 0 and removed afterwards
+	vector<size_t> bad_rows(nr_threads, 0);
+	for (unsigned int t = 0; t < nr_threads; t++) {
+		threads.push_back(std::thread([&, t]() {
+			size_t i = rows[t];
+			for (const char* p = starts[t]; p < starts[t + 1];) {
+				const char* e = lineEnd(p, starts[t + 1]);
+				if (hasContent(p, e)) {
+					float val; int monthID;
+					if (parseRow(p, e, val, monthID)) {
+						data.values[i] = val;
+						data.months[i] = (cl_uchar)monthID;
+					}
+					else {
+						data.months[i] = 0;
+						bad_rows[t]++;
+					}
+					i++;
+				}
+				p = e + 1;
+			}
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	//rare, only for files with malformed rows
+	size_t nr_bad = 0;
+	for (size_t t = 0; t < bad_rows.size(); t++)
+		nr_bad += bad_rows[t];
+	if (nr_bad) {
+		size_t out = 0;
+		for (size_t i = 0; i < data.values.size(); i++) {
+			if (data.months[i]) {
+				data.values[out] = data.values[i];
+				data.months[out] = data.months[i];
+				out++;
+			}
+		}
+		data.values.resize(out);
+		data.months.resize(out);
+	}
+
+	return true;
+}
+
+//the original line by line loader, kept as the baseline the fast loader is measured against
+bool loadTemperatureFileStream(const string& file_name, TemperatureData& data)
+{
+	ifstream file(file_name);
+	if (file.fail())
+		return false;
+
+	data.values.clear();
+	data.months.clear();
+
+	string line;
+	while (getline(file, line))
+	{
+		istringstream linestream(line);
+		float val; int monthID; string tmp;
+		if (!(linestream >> tmp >> tmp >> monthID >> tmp >> tmp >> val) || (monthID < 1) || (monthID > 12))
+			continue; //blank or malformed row, skipped like the fast loader does
+		data.values.push_back(val);
+		data.months.push_back((cl_uchar)monthID);
+	}
+	return true;
+}
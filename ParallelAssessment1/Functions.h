@@ -5,9 +5,14 @@
 #include <iostream>
 #include <sstream>
 #include <cmath>
+#include <algorithm>
+#include <map>
+#include <deque>
+#include <cstring>
 
 #include <CL/cl.hpp>
 #include "Utils.h"
+#include "Profiler.h"
 
 #ifdef __APPLE__
 #include <OpenCL/cl.hpp>
@@ -17,365 +22,1135 @@
 
 typedef float mytype;
 
-//function to find mean of data using opencl kernels
-double parallelMean(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, vector<mytype> A)
+//read only view of values owned by someone else (a vector, the mapped data cache...)
+//cheap to pass by value, so the host functions never copy the data they are given
+struct DataView {
+	const mytype* values;
+	size_t count;
+
+	DataView() : values(NULL), count(0) {}
+	DataView(const mytype* values, size_t count) : values(values), count(count) {}
+	DataView(const vector<mytype>& A) : values(A.data()), count(A.size()) {}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	const mytype* data() const { return values; }
+	const mytype* begin() const { return values; }
+	const mytype* end() const { return values + count; }
+	const mytype& operator[](size_t i) const { return values[i]; }
+};
+
+//host copy of the summary struct in my_kernels.cl, fields must stay in the same order
+struct Summary {
+	cl_float min;
+	cl_float max;
+	cl_float sum;
+	cl_uint count;
+
+	double mean() const { return (double)sum / count; }
+};
+
+//host copy of the moments struct in my_kernels.cl, count and mean plus the central moment sums M2..M4
+struct Moments {
+	cl_uint n;
+	cl_float mean;
+	cl_float m2;
+	cl_float m3;
+	cl_float m4;
+
+	double variance() const { return (double)m2 / n; } //population variance
+	double sampleVariance() const { return (double)m2 / (n - 1); }
+	double stdDev() const { return sqrt(variance()); }
+	double skewness() const { return sqrt((double)n) * m3 / pow((double)m2, 1.5); }
+	double kurtosis() const { return (double)n * m4 / ((double)m2 * m2) - 3.0; } //excess kurtosis, 0 for a normal distribution
+};
+
+//host copy of the float_pair struct in my_kernels.cl, the sum is hi + lo with lo holding the rounding error of hi
+struct FloatPair {
+	cl_float hi;
+	cl_float lo;
+
+	double value() const { return (double)hi + lo; }
+};
+
+//how the sum behind a mean is accumulated, tolerances are against accurateMean (a compensated long double sum, far more
+//accurate than any of these, unlike normalMean whose own error on millions of values is well above 1e-12)
+//and relative to the mean of the absolute values:
+//  PRECISION_FLOAT - plain float tree sum, no fixed bound as the error grows with the data size, so it is not checked
+//  PRECISION_COMPENSATED - double-float sum, within 1e-6 whatever the data size
+//  PRECISION_DOUBLE - double sum, needs cl_khr_fp64, within 1e-12
+enum MeanPrecision {
+	PRECISION_FLOAT,
+	PRECISION_COMPENSATED,
+	PRECISION_DOUBLE
+};
+
+//the bound above for a precision, negative when there is none to check against
+double meanTolerance(MeanPrecision precision)
 {
-	//create kernel for reduction
-	cl::Kernel kernel_1 = cl::Kernel(program, "reduce_add_6");
-	size_t start_nr_elements = A.size(); // save the number of elements for later
+	switch (precision) {
+	case PRECISION_COMPENSATED: return 1e-6;
+	case PRECISION_DOUBLE: return 1e-12;
+	default: return -1;
+	}
+}
 
-	//get device and get the max number of work group size recommended
-	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
-	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+//parse a precision given on the command line, falls back to compensated for anything unknown
+MeanPrecision parseMeanPrecision(const string& name)
+{
+	if (name == "float") return PRECISION_FLOAT;
+	if (name == "double") return PRECISION_DOUBLE;
+	return PRECISION_COMPENSATED;
+}
+
+//true when the device can run the double precision kernels
+bool supportsDouble(const cl::Device& device)
+{
+	return device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp64") != string::npos;
+}
+
+//true when the device works on host memory directly (CPU and integrated GPU), buffers over host data then need no copy
+bool sharesHostMemory(const cl::Device& device)
+{
+	return (device.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU) || device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>();
+}
+
+//read only device buffer over A, which has to stay alive and unchanged while the buffer is used
+//devices sharing host memory read A in place through CL_MEM_USE_HOST_PTR, others get one copy made when the buffer is created
+cl::Buffer inputBuffer(cl::Context& context, const cl::Device& device, DataView A)
+{
+	if (A.empty())
+		return cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(mytype)); //buffers cannot be empty, nothing reads it
+
+	cl_mem_flags flags = CL_MEM_READ_ONLY | (sharesHostMemory(device) ? CL_MEM_USE_HOST_PTR : CL_MEM_COPY_HOST_PTR);
+	return cl::Buffer(context, flags, A.size() * sizeof(mytype), (void*)A.data());
+}
+
+//number of work groups needed to cover all elements with the given local size
+size_t groupCount(size_t nr_elements, size_t local_size)
+{
+	return (nr_elements + local_size - 1) / local_size;
+}
+
+//largest power of two not bigger than n, the sequential addressing kernels need a power of two local size
+size_t powerOfTwoFloor(size_t n)
+{
+	size_t p = 1;
+	while (p * 2 <= n)
+		p *= 2;
+	return p;
+}
+
+//reduction operations that have a kernel in every family
+enum ReduceOp {
+	REDUCE_ADD,
+	REDUCE_MIN,
+	REDUCE_MAX
+};
+
+//reduction kernel families in my_kernels.cl
+enum ReduceVariant {
+	REDUCE_INTERLEAVED, //reduce_add_6, reduce_min, reduce_max - one element per work item, interleaved addressing
+	REDUCE_SEQUENTIAL, //reduce_*_seq - grid-stride loop then sequential addressing
+	REDUCE_UNROLLED //reduce_*_unrolled - as sequential but the last wavefront runs without barriers, opt in only (see supportsUnrolledReduce)
+};
+
+//which kernel family to use and how many elements each work item folds before the local reduction
+//items_per_work_item of 0 lets itemsPerWorkItem pick it from the input size
+struct ReduceConfig {
+	ReduceVariant variant;
+	size_t items_per_work_item;
+};
+
+//kernel name for an operation in a family
+const char* reduceKernelName(ReduceOp op, ReduceVariant variant)
+{
+	static const char* names[3][3] = {
+		{ "reduce_add_6", "reduce_min", "reduce_max" },
+		{ "reduce_add_seq", "reduce_min_seq", "reduce_max_seq" },
+		{ "reduce_add_unrolled", "reduce_min_unrolled", "reduce_max_unrolled" }
+	};
+	return names[variant][op];
+}
+
+const char* reduceVariantName(ReduceVariant variant)
+{
+	switch (variant) {
+	case REDUCE_INTERLEAVED: return "interleaved";
+	case REDUCE_SEQUENTIAL: return "sequential";
+	case REDUCE_UNROLLED: return "unrolled";
+	default: return "unknown";
+	}
+}
 
-	//pad input vector to be multiple of workgroup size as it is more efficient
-	size_t padding_size = A.size() % local_size;
+//parse a family name given on the command line, falls back to sequential for anything unknown
+ReduceVariant parseReduceVariant(const string& name)
+{
+	if (name == "interleaved") return REDUCE_INTERLEAVED;
+	if (name == "unrolled") return REDUCE_UNROLLED;
+	return REDUCE_SEQUENTIAL;
+}
+
+//the unrolled kernels rely on 32 work items running in lockstep, which OpenCL never promises: the preferred multiple is only a hint,
+//and GPUs with independent thread scheduling (NVIDIA Volta and later) or SIMD8/16 code (Intel) give wrong results with it
+//so this only rules out devices where it certainly fails, and the unrolled family is never picked unless asked for
+bool supportsUnrolledReduce(const cl::Device& device, const cl::Kernel& kernel, size_t local_size)
+{
+	if (!(device.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_GPU))
+		return false;
+	return (local_size >= 64) && (kernel.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device) >= 32);
+}
+
+//elements folded by each work item, when not fixed aim for a few work groups per compute unit
+size_t itemsPerWorkItem(const ReduceConfig& config, size_t nr_elements, size_t local_size, size_t compute_units)
+{
+	if (config.variant == REDUCE_INTERLEAVED)
+		return 1; //the original kernels only load one element each
+	if (config.items_per_work_item)
+		return config.items_per_work_item;
+
+	size_t target_groups = std::max<size_t>(compute_units, 1) * 8;
+	return std::min<size_t>(std::max<size_t>(groupCount(nr_elements, local_size * target_groups), 1), 1024);
+}
 
-	//if the input vector is not a multiple of the local_size
-	//insert additional neutral elements (0 for addition) so that the total will not be affected
-	if (padding_size) {
-		//create an extra vector with neutral values
-		std::vector<float> A_ext(local_size - padding_size, 0);
-		//append that extra vector to our input
-		A.insert(A.end(), A_ext.begin(), A_ext.end());
+//runs a reduction kernel level by level until only one value is left and returns it
+//the kernel must take (input, output, local scratch, number of elements) and fill out of range items with its neutral value
+//every level reads one buffer and writes the next so nothing is copied back to the host apart from the final value
+//buffer_B and buffer_C hold the partial results and need room for groupCount(input_elements, local_size) values
+//items_per_work_item above 1 needs one of the grid-stride kernels, each level then shrinks the input by local_size * items_per_work_item
+mytype reduceOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel, size_t local_size, const cl::Buffer& buffer_A, size_t input_elements,
+	const cl::Buffer& buffer_B, const cl::Buffer& buffer_C, size_t items_per_work_item = 1)
+{
+	cl::Buffer buffer_in = buffer_B, buffer_out = buffer_C; //handles only, swapped each level
+
+	size_t nr_groups = groupCount(input_elements, local_size * items_per_work_item); //one partial result per work group
+
+	//first level reads the input data
+	kernel.setArg(0, buffer_A);
+	kernel.setArg(1, buffer_in);
+	kernel.setArg(2, cl::Local(local_size * sizeof(mytype)));//local memory size
+	kernel.setArg(3, (cl_int)input_elements);
+	queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(nr_groups * local_size), cl::NDRange(local_size), NULL,
+		profileKernel(kernel, input_elements * sizeof(mytype), input_elements));
+
+	//keep calling reduction kernel on the partial results until one is left
+	input_elements = nr_groups;
+	while (input_elements > 1) {
+		nr_groups = groupCount(input_elements, local_size * items_per_work_item);
+
+		kernel.setArg(0, buffer_in);
+		kernel.setArg(1, buffer_out);
+		kernel.setArg(3, (cl_int)input_elements);
+		queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(nr_groups * local_size), cl::NDRange(local_size), NULL,
+			profileKernel(kernel, input_elements * sizeof(mytype), input_elements));
+
+		std::swap(buffer_in, buffer_out); //output of this level is input of the next
+		input_elements = nr_groups;
 	}
 
-	size_t input_elements = A.size();//number of input elements after padding
-	size_t input_size = A.size() * sizeof(mytype);//size in bytes of input after padding
+	//read back only the final value
+	mytype result;
+	queue.enqueueReadBuffer(buffer_in, CL_TRUE, 0, sizeof(mytype), &result, NULL, profileEvent("read result", sizeof(mytype)));
 
-	//host - output
-	vector<mytype> B(input_elements);
-	size_t output_size = B.size() * sizeof(mytype);//size in bytes of output
+	return result;
+}
 
-	//device - buffers
-	cl::Buffer buffer_A(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, input_size, &A);
-	cl::Buffer buffer_B(context, CL_MEM_READ_WRITE, output_size, NULL);
+//enqueues every level of a reduction whose partial result T is not a plain value (summaries, compensated sums, doubles)
+//without waiting, and returns the buffer whose first element will hold the result
+//kernel_values turns the input values into one T per work group and kernel_partials merges those until one is left
+//buffer_B and buffer_C need room for groupCount(input_elements, local_size) values of T
+//the first kernel waits for wait_events, e.g. the upload of buffer_A on another queue
+//value_size is the size of one input value, only used for the profile
+template <typename T>
+cl::Buffer enqueueReducePartials(cl::CommandQueue& queue, cl::Kernel& kernel_values, cl::Kernel& kernel_partials, size_t local_size,
+	const cl::Buffer& buffer_A, size_t input_elements, const cl::Buffer& buffer_B, const cl::Buffer& buffer_C, size_t items_per_work_item = 1,
+	const vector<cl::Event>* wait_events = NULL, size_t value_size = sizeof(mytype))
+{
+	cl::Buffer buffer_in = buffer_B, buffer_out = buffer_C;
+
+	size_t nr_groups = groupCount(input_elements, local_size * items_per_work_item); //one partial per work group
+
+	//first pass turns the values into one partial per work group
+	kernel_values.setArg(0, buffer_A);
+	kernel_values.setArg(1, buffer_in);
+	kernel_values.setArg(2, cl::Local(local_size * sizeof(T)));//local memory size
+	kernel_values.setArg(3, (cl_int)input_elements);
+	queue.enqueueNDRangeKernel(kernel_values, cl::NullRange, cl::NDRange(nr_groups * local_size), cl::NDRange(local_size), wait_events,
+		profileKernel(kernel_values, input_elements * value_size, input_elements));
+
+	//keep merging partials until only one is left, this all stays on the device
+	input_elements = nr_groups;
+	while (input_elements > 1) {
+		nr_groups = groupCount(input_elements, local_size * items_per_work_item);
+
+		kernel_partials.setArg(0, buffer_in);
+		kernel_partials.setArg(1, buffer_out);
+		kernel_partials.setArg(2, cl::Local(local_size * sizeof(T)));
+		kernel_partials.setArg(3, (cl_int)input_elements);
+		queue.enqueueNDRangeKernel(kernel_partials, cl::NullRange, cl::NDRange(nr_groups * local_size), cl::NDRange(local_size), NULL,
+			profileKernel(kernel_partials, input_elements * sizeof(T), input_elements));
+
+		std::swap(buffer_in, buffer_out); //output of this level is input of the next
+		input_elements = nr_groups;
+	}
 
-	//Copy vector A to device memory
-	queue.enqueueWriteBuffer(buffer_A, CL_TRUE, 0, input_size, &A[0]);
+	return buffer_in;
+}
 
-	//Setup kernal arguments
-	kernel_1.setArg(0, buffer_A);
-	kernel_1.setArg(1, cl::Local(local_size * sizeof(mytype)));//local memory size
+//same as reduceOnDevice but for kernels whose partial result T is not a plain value, see enqueueReducePartials
+template <typename T>
+T reducePartialsOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel_values, cl::Kernel& kernel_partials, size_t local_size,
+	const cl::Buffer& buffer_A, size_t input_elements, const cl::Buffer& buffer_B, const cl::Buffer& buffer_C, size_t items_per_work_item = 1,
+	size_t value_size = sizeof(mytype))
+{
+	cl::Buffer buffer_result = enqueueReducePartials<T>(queue, kernel_values, kernel_partials, local_size, buffer_A, input_elements,
+		buffer_B, buffer_C, items_per_work_item, NULL, value_size);
 
-	//call all kernels in a sequence
-	queue.enqueueNDRangeKernel(kernel_1, cl::NullRange, cl::NDRange(A.size()), cl::NDRange(local_size));
+	//read the final partial back
+	T result;
+	queue.enqueueReadBuffer(buffer_result, CL_TRUE, 0, sizeof(T), &result, NULL, profileEvent("read result", sizeof(T)));
 
-	//keep calling reduction kernel until input is smaller than workgroup size
-	// this means that the first element will be the sum of the vector
-	while (input_elements / local_size > local_size) {
-		input_elements = input_elements / local_size;
+	return result;
+}
 
-		size_t padding_size2 = input_elements % local_size;
+//fused min/max/sum/count of the values in buffer_A
+Summary summaryOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel_values, cl::Kernel& kernel_partials, size_t local_size,
+	const cl::Buffer& buffer_A, size_t input_elements, const cl::Buffer& buffer_B, const cl::Buffer& buffer_C)
+{
+	return reducePartialsOnDevice<Summary>(queue, kernel_values, kernel_partials, local_size, buffer_A, input_elements, buffer_B, buffer_C);
+}
 
-		//if the input vector is not a multiple of the local_size
-		//then add to input size and make the added element 0
-		if (padding_size2) {
-			//read the buffer back into A
-			queue.enqueueReadBuffer(buffer_A, CL_TRUE, 0, output_size, &A[0]); // read out buffer_A and then pad
-			size_t neededElements = local_size - padding_size2;
+//count, mean and central moments of the values in buffer_A in one pass, reduced like the summary
+Moments momentsOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel_values, cl::Kernel& kernel_partials, size_t local_size,
+	const cl::Buffer& buffer_A, size_t input_elements, const cl::Buffer& buffer_B, const cl::Buffer& buffer_C, size_t items_per_work_item = 1)
+{
+	return reducePartialsOnDevice<Moments>(queue, kernel_values, kernel_partials, local_size, buffer_A, input_elements, buffer_B, buffer_C, items_per_work_item);
+}
 
-			for (auto i = A.begin() + input_elements; i < (A.begin() + input_elements + neededElements); i++) {
-				*i = 0; // use zero as neutral element as it does not affect addition
-			}
+//summary with no values in it, merging it into another changes nothing
+Summary emptySummary()
+{
+	Summary summary = { INFINITY, -INFINITY, 0, 0 };
+	return summary;
+}
 
-			input_elements = input_elements + neededElements; // add the pad elements
+//most keys reduce_summary_by_key handles, same as MAX_KEYS in my_kernels.cl
+const int max_summary_keys = 16;
 
-			//write bac to buffer
-			queue.enqueueWriteBuffer(buffer_A, CL_TRUE, 0, input_size, &A[0]); // write vector A into device
+//folds the nr_keys partial summaries of each of nr_groups work groups written by reduce_summary_by_key, sums in double
+vector<Summary> mergeKeyedSummaries(const vector<Summary>& partials, size_t nr_groups, int nr_keys)
+{
+	vector<Summary> result(nr_keys, emptySummary());
+	vector<double> sums(nr_keys, 0);
+	for (size_t g = 0; g < nr_groups; g++) {
+		for (int k = 0; k < nr_keys; k++) {
+			const Summary& p = partials[g * nr_keys + k];
+			result[k].min = std::min(result[k].min, p.min);
+			result[k].max = std::max(result[k].max, p.max);
+			result[k].count += p.count;
+			sums[k] += p.sum;
 		}
+	}
+	for (int k = 0; k < nr_keys; k++)
+		result[k].sum = (cl_float)sums[k];
+
+	return result;
+}
+
+//enqueues reduce_summary_by_key without reading anything back, nr_groups work groups each write nr_keys partial summaries
+//to buffer_B for mergeKeyedSummaries, the kernel waits for wait_events
+void enqueueSummaryByKey(cl::CommandQueue& queue, cl::Kernel& kernel, size_t local_size, size_t nr_groups,
+	const cl::Buffer& buffer_A, const cl::Buffer& buffer_keys, size_t input_elements, int nr_keys, const cl::Buffer& buffer_B,
+	const vector<cl::Event>* wait_events = NULL)
+{
+	if ((nr_keys < 1) || (nr_keys > max_summary_keys))
+		throw cl::Error(CL_INVALID_VALUE, "Summary by key supports 1 to 16 keys");
+
+	kernel.setArg(0, buffer_A);
+	kernel.setArg(1, buffer_keys);
+	kernel.setArg(2, buffer_B);
+	kernel.setArg(3, cl::Local(local_size * sizeof(Summary)));//local memory size
+	kernel.setArg(4, (cl_int)input_elements);
+	kernel.setArg(5, (cl_int)nr_keys);
+	queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(nr_groups * local_size), cl::NDRange(local_size), wait_events,
+		profileKernel(kernel, input_elements * (sizeof(mytype) + sizeof(cl_uchar)), input_elements));
+}
+
+//min/max/sum/count of the values in buffer_A for every key 1..nr_keys in buffer_keys (one uchar per value) with a single launch
+//nr_groups work groups each write nr_keys partial summaries to buffer_B, few enough to fold on the host (sums in double)
+//returns nr_keys summaries, the first for key 1
+vector<Summary> summaryByKeyOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel, size_t local_size, size_t nr_groups,
+	const cl::Buffer& buffer_A, const cl::Buffer& buffer_keys, size_t input_elements, int nr_keys, const cl::Buffer& buffer_B)
+{
+	enqueueSummaryByKey(queue, kernel, local_size, nr_groups, buffer_A, buffer_keys, input_elements, nr_keys, buffer_B);
 
-		queue.enqueueNDRangeKernel(kernel_1, cl::NullRange, cl::NDRange(input_elements), cl::NDRange(local_size));
+	vector<Summary> partials(nr_groups * nr_keys);
+	queue.enqueueReadBuffer(buffer_B, CL_TRUE, 0, partials.size() * sizeof(Summary), &partials[0], NULL,
+		profileEvent("read partials", partials.size() * sizeof(Summary)));
+
+	return mergeKeyedSummaries(partials, nr_groups, nr_keys);
+}
+
+//order preserving map from float to uint, same as float_key in my_kernels.cl, and back again
+cl_uint floatKey(float f)
+{
+	cl_uint u;
+	memcpy(&u, &f, sizeof(u));
+	return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+float keyFloat(cl_uint key)
+{
+	cl_uint u = (key & 0x80000000u) ? (key & 0x7FFFFFFFu) : ~key;
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+//exact value at rank (0 based, in ascending order) of the values in buffer_A without sorting them
+//radix select: each pass counts the next 8 bits of the keys that still match the digits found so far, 4 passes in total
+//buffer_H needs room for 256 counters
+mytype selectOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel, size_t local_size, size_t nr_groups,
+	const cl::Buffer& buffer_A, size_t input_elements, size_t rank, const cl::Buffer& buffer_H)
+{
+	if (rank >= input_elements)
+		throw cl::Error(CL_INVALID_VALUE, "Rank is past the end of the data");
+
+	kernel.setArg(0, buffer_A);
+	kernel.setArg(1, buffer_H);
+	kernel.setArg(2, cl::Local(256 * sizeof(cl_uint)));
+	kernel.setArg(3, (cl_int)input_elements);
+
+	cl_uint prefix = 0, prefix_mask = 0;
+	vector<cl_uint> H(256);
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		queue.enqueueFillBuffer(buffer_H, (cl_uint)0, 0, 256 * sizeof(cl_uint), NULL, profileEvent("fill", 256 * sizeof(cl_uint)));
+		kernel.setArg(4, prefix);
+		kernel.setArg(5, prefix_mask);
+		kernel.setArg(6, (cl_int)shift);
+		queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(nr_groups * local_size), cl::NDRange(local_size), NULL,
+			profileKernel(kernel, input_elements * sizeof(mytype), input_elements));
+		queue.enqueueReadBuffer(buffer_H, CL_TRUE, 0, 256 * sizeof(cl_uint), &H[0], NULL, profileEvent("read histogram", 256 * sizeof(cl_uint)));
+
+		//find the digit whose bucket holds the rank, the rank then counts from the start of that bucket
+		cl_uint digit = 0;
+		while (rank >= H[digit]) {
+			rank -= H[digit];
+			digit++;
+		}
+		prefix |= digit << shift;
+		prefix_mask |= 0xFFu << shift;
 	}
 
-	//do final reduction, this time first element will be total sum
-	queue.enqueueReadBuffer(buffer_A, CL_TRUE, 0, output_size, &A[0]);
-	size_t start = input_elements / local_size;
-	for (auto i = A.begin() + start; i < (A.begin() + local_size); i++) {
-		*i = 0; // use zero as neutral element as it does not affect addition
+	return keyFloat(prefix);
+}
+
+//values at fractions ps (0 to 1) through the sorted data, interpolated between the two nearest ranks like numpy's default
+//every rank is found by selectOnDevice, so the data is never sorted
+vector<double> percentilesOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel, size_t local_size, size_t nr_groups,
+	const cl::Buffer& buffer_A, size_t input_elements, const vector<double>& ps, const cl::Buffer& buffer_H)
+{
+	if (!input_elements)
+		throw cl::Error(CL_INVALID_VALUE, "Percentiles of an empty dataset");
+
+	std::map<size_t, mytype> selected; //ranks already found, neighbouring percentiles often share them
+	vector<double> result;
+	for (size_t i = 0; i < ps.size(); i++) {
+		if (!(ps[i] >= 0) || (ps[i] > 1))
+			throw cl::Error(CL_INVALID_VALUE, "Percentiles must be between 0 and 1");
+
+		double pos = ps[i] * (input_elements - 1);
+		size_t lo = (size_t)floor(pos), hi = (size_t)ceil(pos);
+		if (!selected.count(lo))
+			selected[lo] = selectOnDevice(queue, kernel, local_size, nr_groups, buffer_A, input_elements, lo, buffer_H);
+		if (!selected.count(hi))
+			selected[hi] = selectOnDevice(queue, kernel, local_size, nr_groups, buffer_A, input_elements, hi, buffer_H);
+
+		result.push_back(selected[lo] + (pos - lo) * ((double)selected[hi] - selected[lo]));
 	}
+	return result;
+}
 
-	input_elements = local_size;
-	queue.enqueueWriteBuffer(buffer_A, CL_TRUE, 0, input_size, &A[0]);
-	queue.enqueueNDRangeKernel(kernel_1, cl::NullRange, cl::NDRange(input_elements), cl::NDRange(local_size));
+//smallest power of two not smaller than n, the length a bitonic sort works on
+size_t powerOfTwoCeil(size_t n)
+{
+	size_t p = 1;
+	while (p < n)
+		p *= 2;
+	return p;
+}
 
-	//read the buffer A from device to host vector B
-	queue.enqueueReadBuffer(buffer_A, CL_TRUE, 0, output_size, &B[0]);
-	
-	//return mean using sum total divided by number of elements before padding
-	return B[0]/start_nr_elements;
+//sorts the first input_elements values of buffer_A ascending in place with a bitonic sort
+//buffer_A must have room for powerOfTwoCeil(input_elements) values, the tail is padded with +infinity so it sorts to the end
+//the merge steps wider than a work group run one launch each, the narrower ones of every stage run together in local memory
+void sortOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel_step, cl::Kernel& kernel_local, size_t local_size,
+	const cl::Buffer& buffer_A, size_t input_elements)
+{
+	size_t padded = powerOfTwoCeil(input_elements);
+	if (padded < 2)
+		return;
+	if (padded > input_elements)
+		queue.enqueueFillBuffer(buffer_A, (cl_float)INFINITY, input_elements * sizeof(mytype), (padded - input_elements) * sizeof(mytype), NULL,
+			profileEvent("fill", (padded - input_elements) * sizeof(mytype)));
+
+	local_size = std::min(powerOfTwoFloor(local_size), padded);
+	kernel_step.setArg(0, buffer_A);
+	kernel_local.setArg(0, buffer_A);
+	kernel_local.setArg(1, cl::Local(local_size * sizeof(mytype)));
+
+	for (size_t k = 2; k <= padded; k <<= 1) {
+		size_t j = k / 2;
+		for (; j >= local_size; j >>= 1) {
+			kernel_step.setArg(1, (cl_uint)j);
+			kernel_step.setArg(2, (cl_uint)k);
+			queue.enqueueNDRangeKernel(kernel_step, cl::NullRange, cl::NDRange(padded), cl::NDRange(local_size), NULL,
+				profileKernel(kernel_step, 2 * padded * sizeof(mytype), padded));
+		}
+		if (j) {
+			kernel_local.setArg(2, (cl_uint)j);
+			kernel_local.setArg(3, (cl_uint)k);
+			queue.enqueueNDRangeKernel(kernel_local, cl::NullRange, cl::NDRange(padded), cl::NDRange(local_size), NULL,
+				profileKernel(kernel_local, 2 * padded * sizeof(mytype), padded));
+		}
+	}
 }
 
-//function to find max of vector using reduction in parallel
-float parallelMax(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, vector<mytype> A)
+//block scan kernel for op, scanOffsetKernelName the one that adds the totals of earlier blocks back
+const char* scanKernelName(ReduceOp op)
 {
-	//create kernel for max reduction
-	cl::Kernel kernel_1 = cl::Kernel(program, "reduce_max");
+	static const char* names[3] = { "scan_add", "scan_min", "scan_max" };
+	return names[op];
+}
 
-	//get device and get the max number of work group size recommended
-	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
-	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+const char* scanOffsetKernelName(ReduceOp op)
+{
+	static const char* names[3] = { "scan_offset_add", "scan_offset_min", "scan_offset_max" };
+	return names[op];
+}
 
-	//pad input vector to be multiple of workgroup size as it is more efficient
-	size_t padding_size = A.size() % local_size;
+//values one work group of the block scan kernels covers, two per work item
+size_t scanBlockSize(size_t local_size)
+{
+	return 2 * local_size;
+}
 
-	//if the input vector is not a multiple of the local_size
-	//insert additional neutral elements (-INFINITY for max) so that the top value will be max
-	if (padding_size) {
-		//create an extra vector with neutral values
-		std::vector<float> A_ext(local_size - padding_size, -INFINITY);
-		//append that extra vector to our input
-		A.insert(A.end(), A_ext.begin(), A_ext.end());
+//buffers for the block totals of every level of a scan over input_elements values of T, see enqueueScan
+//two per level, the totals and their scan, and just the totals on the last level where one block is left
+template <typename T>
+vector<cl::Buffer> scanBuffers(cl::Context& context, size_t input_elements, size_t local_size)
+{
+	vector<cl::Buffer> levels;
+	size_t nr_groups = std::max(groupCount(input_elements, scanBlockSize(local_size)), (size_t)1);
+	while (true) {
+		levels.push_back(cl::Buffer(context, CL_MEM_READ_WRITE, nr_groups * sizeof(T)));
+		if (nr_groups == 1)
+			break;
+		levels.push_back(cl::Buffer(context, CL_MEM_READ_WRITE, nr_groups * sizeof(T)));
+		nr_groups = groupCount(nr_groups, scanBlockSize(local_size));
 	}
+	return levels;
+}
 
-	size_t input_elements = A.size();//number of input elements after padding
-	size_t input_size = A.size() * sizeof(mytype);//size in bytes after padding
+//enqueues a scan of the first input_elements values of buffer_A into buffer_B without reading anything back
+//inclusive gives B[i] = A[0] op ... op A[i], exclusive gives B[i] = A[0] op ... op A[i - 1] with B[0] the identity (0, +inf or -inf)
+//kernel_block scans every block of 2 * local_size values (Blelloch, local_size a power of two) and keeps the block totals in levels,
+//those are scanned the same way one level up and kernel_offset adds them back, so the work stays linear for any size
+//levels comes from scanBuffers<T> for the same input_elements and local_size, buffer_B may be buffer_A to scan in place
+template <typename T>
+void enqueueScan(cl::CommandQueue& queue, cl::Kernel& kernel_block, cl::Kernel& kernel_offset, size_t local_size,
+	const cl::Buffer& buffer_A, size_t input_elements, const cl::Buffer& buffer_B, bool inclusive, const vector<cl::Buffer>& levels, size_t level = 0)
+{
+	if (!input_elements)
+		return;
+
+	size_t nr_groups = groupCount(input_elements, scanBlockSize(local_size));
+	const cl::Buffer& buffer_totals = levels[2 * level];
+
+	kernel_block.setArg(0, buffer_A);
+	kernel_block.setArg(1, buffer_B);
+	kernel_block.setArg(2, buffer_totals);
+	kernel_block.setArg(3, cl::Local(scanBlockSize(local_size) * sizeof(T)));
+	kernel_block.setArg(4, (cl_int)input_elements);
+	kernel_block.setArg(5, (cl_int)inclusive);
+	queue.enqueueNDRangeKernel(kernel_block, cl::NullRange, cl::NDRange(nr_groups * local_size), cl::NDRange(local_size), NULL,
+		profileKernel(kernel_block, 2 * input_elements * sizeof(T), input_elements));
+
+	//one block has no earlier blocks to add
+	if (nr_groups == 1)
+		return;
+
+	//exclusive scan of the block totals is what comes before every block
+	const cl::Buffer& buffer_offsets = levels[2 * level + 1];
+	enqueueScan<T>(queue, kernel_block, kernel_offset, local_size, buffer_totals, nr_groups, buffer_offsets, false, levels, level + 1);
+
+	kernel_offset.setArg(0, buffer_B);
+	kernel_offset.setArg(1, buffer_offsets);
+	kernel_offset.setArg(2, (cl_int)input_elements);
+	queue.enqueueNDRangeKernel(kernel_offset, cl::NullRange, cl::NDRange(groupCount(input_elements, local_size) * local_size), cl::NDRange(local_size), NULL,
+		profileKernel(kernel_offset, 2 * input_elements * sizeof(T), input_elements));
+}
 
-	//host - output
-	vector<mytype> B(input_elements);
-	size_t output_size = B.size() * sizeof(mytype);//size in bytes of output
-    
-    //Copy vector A to device memory and initialize output
-	cl::Buffer buffer_A(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, input_size, &A);
+//scan of the values in buffer_A read back to the host, see enqueueScan
+template <typename T>
+vector<T> scanOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel_block, cl::Kernel& kernel_offset, size_t local_size,
+	const cl::Buffer& buffer_A, size_t input_elements, const cl::Buffer& buffer_B, bool inclusive, const vector<cl::Buffer>& levels)
+{
+	vector<T> result(input_elements);
+	if (!input_elements)
+		return result;
 
-	//Copy vector A to device memory
-	queue.enqueueWriteBuffer(buffer_A, CL_TRUE, 0, input_size, &A[0]);
+	enqueueScan<T>(queue, kernel_block, kernel_offset, local_size, buffer_A, input_elements, buffer_B, inclusive, levels);
+	queue.enqueueReadBuffer(buffer_B, CL_TRUE, 0, input_elements * sizeof(T), &result[0], NULL, profileEvent("read", input_elements * sizeof(T)));
 
-	//Setup and execute all kernels (i.e. device code)
-	kernel_1.setArg(0, buffer_A);
-	kernel_1.setArg(1, cl::Local(local_size * sizeof(mytype)));//local memory size
+	return result;
+}
 
-	//call all kernels in a sequence
-	queue.enqueueNDRangeKernel(kernel_1, cl::NullRange, cl::NDRange(A.size()), cl::NDRange(local_size));
+//moving mean, min and max of every window of w consecutive values, window k covers values k to k + w - 1
+struct Rolling {
+	int window;
+	vector<float> mean;
+	vector<float> min;
+	vector<float> max;
+};
 
-	//keep calling reduction kernel until input is smaller than workgroup size
-	//this means that the first element will be the max of the vector
-	while (input_elements / local_size > local_size) {
-		input_elements = input_elements / local_size;
+//number of windows of w values in input_elements values, 0 when w does not fit
+size_t rollingWindows(size_t input_elements, int w)
+{
+	return ((w >= 1) && ((size_t)w <= input_elements)) ? input_elements - w + 1 : 0;
+}
 
-		size_t padding_size2 = input_elements % local_size;
+//enqueues both passes of the van Herk/Gil-Werman rolling windows without reading anything back
+//kernel_blocks finds the running results from either end of every block of w values, kernel_windows combines two of them per window,
+//so the work does not grow with w
+//buffer_G and buffer_H need room for 3 * input_elements floats, buffer_R for 3 * rollingWindows(input_elements, w) (means, mins, maxes)
+void enqueueRolling(cl::CommandQueue& queue, cl::Kernel& kernel_blocks, cl::Kernel& kernel_windows, size_t local_size,
+	const cl::Buffer& buffer_A, size_t input_elements, int w, const cl::Buffer& buffer_G, const cl::Buffer& buffer_H, const cl::Buffer& buffer_R)
+{
+	size_t nr_windows = rollingWindows(input_elements, w);
+	if (!nr_windows)
+		throw cl::Error(CL_INVALID_VALUE, "Rolling window must be between 1 and the number of values");
+
+	//one work item per block and direction
+	size_t nr_items = 2 * groupCount(input_elements, w);
+	kernel_blocks.setArg(0, buffer_A);
+	kernel_blocks.setArg(1, buffer_G);
+	kernel_blocks.setArg(2, buffer_H);
+	kernel_blocks.setArg(3, (cl_int)input_elements);
+	kernel_blocks.setArg(4, (cl_int)w);
+	queue.enqueueNDRangeKernel(kernel_blocks, cl::NullRange, cl::NDRange(groupCount(nr_items, local_size) * local_size), cl::NDRange(local_size), NULL,
+		profileKernel(kernel_blocks, 4 * input_elements * sizeof(mytype), input_elements));
+
+	kernel_windows.setArg(0, buffer_G);
+	kernel_windows.setArg(1, buffer_H);
+	kernel_windows.setArg(2, buffer_R);
+	kernel_windows.setArg(3, (cl_int)input_elements);
+	kernel_windows.setArg(4, (cl_int)w);
+	queue.enqueueNDRangeKernel(kernel_windows, cl::NullRange, cl::NDRange(groupCount(nr_windows, local_size) * local_size), cl::NDRange(local_size), NULL,
+		profileKernel(kernel_windows, 9 * nr_windows * sizeof(mytype), nr_windows));
+}
 
-		//if the input vector is not a multiple of the local_size
-		//then add to input size and make the added element 0
-		if (padding_size2) {
-			//read the buffer back into A
-			queue.enqueueReadBuffer(buffer_A, CL_TRUE, 0, output_size, &A[0]);
-			size_t neededElements = local_size - padding_size2;
+//moving mean, min and max of the values in buffer_A over windows of w values, see enqueueRolling
+Rolling rollingOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel_blocks, cl::Kernel& kernel_windows, size_t local_size,
+	const cl::Buffer& buffer_A, size_t input_elements, int w, const cl::Buffer& buffer_G, const cl::Buffer& buffer_H, const cl::Buffer& buffer_R)
+{
+	enqueueRolling(queue, kernel_blocks, kernel_windows, local_size, buffer_A, input_elements, w, buffer_G, buffer_H, buffer_R);
+
+	size_t nr_windows = rollingWindows(input_elements, w);
+	Rolling rolling;
+	rolling.window = w;
+	rolling.mean.resize(nr_windows);
+	rolling.min.resize(nr_windows);
+	rolling.max.resize(nr_windows);
+	queue.enqueueReadBuffer(buffer_R, CL_FALSE, 0, nr_windows * sizeof(float), &rolling.mean[0], NULL, profileEvent("read", nr_windows * sizeof(float)));
+	queue.enqueueReadBuffer(buffer_R, CL_FALSE, nr_windows * sizeof(float), nr_windows * sizeof(float), &rolling.min[0], NULL,
+		profileEvent("read", nr_windows * sizeof(float)));
+	queue.enqueueReadBuffer(buffer_R, CL_TRUE, 2 * nr_windows * sizeof(float), nr_windows * sizeof(float), &rolling.max[0], NULL,
+		profileEvent("read", nr_windows * sizeof(float)));
+
+	return rolling;
+}
 
-			//set netural values for current input size
-			for (auto i = A.begin() + input_elements; i != (A.begin() + input_elements + neededElements); i++) {
-				*i = -INFINITY; //neutral value for max is -INFINITY
-			}
+//bins a histogram counts into, either nr_bins equal width bins starting at min or nr_bins bins between explicit edges
+struct BinLayout {
+	int nr_bins;
+	float min;
+	float bin_width;
+	vector<float> edges; //nr_bins + 1 increasing edges, empty for equal width bins
+};
+
+//histogram counts, values outside the bins are counted separately instead of being dropped
+struct Histogram {
+	vector<int> counts; //one per bin
+	int underflow; //values below the first bin
+	int overflow; //values above the last bin, and NaNs
+	vector<float> edges; //nr_bins + 1 edges, bin i is edges[i] to edges[i + 1]
+};
+
+//nr_bins equal width bins from min to max
+BinLayout uniformBins(float min, float max, int nr_bins)
+{
+	if (nr_bins < 1)
+		throw cl::Error(CL_INVALID_VALUE, "A histogram needs at least one bin");
+
+	BinLayout layout;
+	layout.nr_bins = nr_bins;
+	layout.min = min;
+	layout.bin_width = (max - min) / nr_bins;
+	return layout;
+}
 
-			input_elements = input_elements + neededElements;
+//bins between the given edges, e.g. percentile style buckets, the last bin includes its top edge
+BinLayout edgeBins(const vector<float>& edges)
+{
+	if (edges.size() < 2)
+		throw cl::Error(CL_INVALID_VALUE, "Bin edges need at least two values");
+	for (size_t i = 1; i < edges.size(); i++) {
+		if (!(edges[i - 1] < edges[i]))
+			throw cl::Error(CL_INVALID_VALUE, "Bin edges must be strictly increasing");
+	}
 
-			//write A back to buffer
-			queue.enqueueWriteBuffer(buffer_A, CL_TRUE, 0, input_size, &A[0]);
-		}
-		//execute kernal on device
-		queue.enqueueNDRangeKernel(kernel_1, cl::NullRange, cl::NDRange(input_elements), cl::NDRange(local_size));
+	BinLayout layout;
+	layout.nr_bins = (int)edges.size() - 1;
+	layout.min = edges.front();
+	layout.bin_width = 0;
+	layout.edges = edges;
+	return layout;
+}
+
+//device copy of the bin edges for the kernels' __constant argument, equal width layouts get a one value placeholder
+cl::Buffer edgesBuffer(cl::Context& context, const cl::Device& device, const BinLayout& layout)
+{
+	if (layout.edges.empty()) {
+		float unused = 0;
+		return cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(float), &unused);
 	}
 
-	//do final reduction, this time first element will be max value
-	queue.enqueueReadBuffer(buffer_A, CL_TRUE, 0, output_size, &A[0]);
-	size_t start = input_elements / local_size;
-	for (auto i = A.begin() + start; i != (A.begin() + local_size); i++) {
-		*i = -INFINITY; //neutral value for max is -INFINITY
+	size_t edges_size = layout.edges.size() * sizeof(float);
+	if (edges_size > device.getInfo<CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE>())
+		throw cl::Error(CL_INVALID_VALUE, "Too many bin edges to fit in the device's constant memory");
+
+	return cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, edges_size, (void*)&layout.edges[0]);
+}
+
+//number of counters the kernels write, the bins plus underflow and overflow
+size_t histogramCounters(const BinLayout& layout)
+{
+	return layout.nr_bins + 2;
+}
+
+//split the raw device counters into bins, underflow and overflow and fill in the edges
+Histogram makeHistogram(const vector<int>& H, const BinLayout& layout)
+{
+	Histogram histogram;
+	histogram.counts.assign(H.begin(), H.begin() + layout.nr_bins);
+	histogram.underflow = H[layout.nr_bins];
+	histogram.overflow = H[layout.nr_bins + 1];
+
+	if (layout.edges.empty()) {
+		for (int i = 0; i <= layout.nr_bins; i++)
+			histogram.edges.push_back((i*layout.bin_width) + layout.min);
+	}
+	else {
+		histogram.edges = layout.edges;
 	}
-	input_elements = local_size;
-	queue.enqueueWriteBuffer(buffer_A, CL_TRUE, 0, input_size, &A[0]);
-	queue.enqueueNDRangeKernel(kernel_1, cl::NullRange, cl::NDRange(input_elements), cl::NDRange(local_size));
+	return histogram;
+}
+
+//sets the arguments both histogram kernels share, in the order they share them
+void setHistogramArgs(cl::Kernel& kernel, cl_uint first_arg, size_t input_elements, const BinLayout& layout, const cl::Buffer& buffer_edges)
+{
+	kernel.setArg(first_arg, (cl_int)input_elements);
+	kernel.setArg(first_arg + 1, (cl_int)layout.nr_bins);
+	kernel.setArg(first_arg + 2, layout.bin_width);
+	kernel.setArg(first_arg + 3, layout.min);
+	kernel.setArg(first_arg + 4, buffer_edges);
+	kernel.setArg(first_arg + 5, (cl_int)!layout.edges.empty());
+}
 
-	//read the buffer A from device to host vector B
-	queue.enqueueReadBuffer(buffer_A, CL_TRUE, 0, output_size, &B[0]);
+//enqueues the global atomic histogram kernel without clearing or reading buffer_H, so counts add up over several calls
+void enqueueHistogram(cl::CommandQueue& queue, cl::Kernel& kernel, size_t local_size, const cl::Buffer& buffer_A, size_t input_elements,
+	const BinLayout& layout, const cl::Buffer& buffer_edges, const cl::Buffer& buffer_H, const vector<cl::Event>* wait_events = NULL)
+{
+	//Setup and execute all kernels (i.e. device code)
+	kernel.setArg(0, buffer_A);
+	kernel.setArg(1, buffer_H);
+	setHistogramArgs(kernel, 2, input_elements, layout, buffer_edges);
 
-	return B[0];
+	queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(groupCount(input_elements, local_size) * local_size), cl::NDRange(local_size), wait_events,
+		profileKernel(kernel, input_elements * sizeof(mytype), input_elements));
 }
 
-//function to find min of vector using reduction in parallel
-float parallelMin(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, vector<mytype> A)
+//fills a histogram of the values in buffer_A on the device, buffer_H needs room for histogramCounters(layout) ints
+Histogram histogramOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel, size_t local_size, const cl::Buffer& buffer_A, size_t input_elements,
+	const BinLayout& layout, const cl::Buffer& buffer_edges, const cl::Buffer& buffer_H)
+{
+	size_t nr_counters = histogramCounters(layout);
+	vector<int> H(nr_counters); // create out put host vector for histogram
+
+	queue.enqueueFillBuffer(buffer_H, 0, 0, sizeof(int)*(nr_counters), NULL, profileEvent("fill", sizeof(int)*(nr_counters)));//zero H buffer on device memory
+
+	enqueueHistogram(queue, kernel, local_size, buffer_A, input_elements, layout, buffer_edges, buffer_H);
+
+	//read buffer_H into host code vector H
+	queue.enqueueReadBuffer(buffer_H, CL_TRUE, 0, sizeof(int)*(nr_counters), &H[0], NULL, profileEvent("read histogram", sizeof(int)*(nr_counters)));
+
+	return makeHistogram(H, layout);
+}
+
+//which histogram kernel to use
+enum HistogramMethod {
+	HIST_AUTO, //local when the bins fit in local memory, global otherwise
+	HIST_GLOBAL, //hist_atomic - one global atomic per element
+	HIST_LOCAL //hist_local - per work group sub-histograms merged at the end
+};
+
+//number of sub-histogram copies hist_local can keep for the layout in local_mem_size bytes of local memory
+//more copies means fewer work items sharing a counter, capped at 16 and a power of two so items spread evenly
+//0 means not even one copy fits and the global kernel has to be used
+int histogramCopies(cl_ulong local_mem_size, const BinLayout& layout, size_t local_size)
+{
+	cl_ulong fit = local_mem_size / (sizeof(int) * (cl_ulong)histogramCounters(layout));
+	if (!fit)
+		return 0;
+
+	cl_ulong copies = 1;
+	while ((copies * 2 <= fit) && (copies * 2 <= 16) && (copies * 2 <= local_size))
+		copies *= 2;
+	return (int)copies;
+}
+
+//enqueues the local memory histogram kernel without clearing or reading buffer_H, so counts add up over several calls
+//nr_groups work groups each walk a grid-stride slice of the data, the kernel waits for wait_events
+void enqueueHistogramLocal(cl::CommandQueue& queue, cl::Kernel& kernel, size_t local_size, size_t nr_groups, const cl::Buffer& buffer_A, size_t input_elements,
+	const BinLayout& layout, int copies, const cl::Buffer& buffer_edges, const cl::Buffer& buffer_H, const vector<cl::Event>* wait_events = NULL)
+{
+	kernel.setArg(0, buffer_A);
+	kernel.setArg(1, buffer_H);
+	kernel.setArg(2, cl::Local(sizeof(int) * histogramCounters(layout) * copies));//local sub-histograms
+	setHistogramArgs(kernel, 3, input_elements, layout, buffer_edges);
+	kernel.setArg(9, (cl_int)copies);
+
+	nr_groups = std::max<size_t>(std::min(nr_groups, groupCount(input_elements, local_size)), 1);
+	queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(nr_groups * local_size), cl::NDRange(local_size), wait_events,
+		profileKernel(kernel, input_elements * sizeof(mytype), input_elements));
+}
+
+//same as histogramOnDevice but with the local memory kernel
+Histogram histogramLocalOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel, size_t local_size, size_t nr_groups, const cl::Buffer& buffer_A, size_t input_elements,
+	const BinLayout& layout, int copies, const cl::Buffer& buffer_edges, const cl::Buffer& buffer_H)
+{
+	size_t nr_counters = histogramCounters(layout);
+	vector<int> H(nr_counters);
+
+	queue.enqueueFillBuffer(buffer_H, 0, 0, sizeof(int)*(nr_counters), NULL, profileEvent("fill", sizeof(int)*(nr_counters)));//zero H buffer on device memory
+
+	enqueueHistogramLocal(queue, kernel, local_size, nr_groups, buffer_A, input_elements, layout, copies, buffer_edges, buffer_H);
+
+	queue.enqueueReadBuffer(buffer_H, CL_TRUE, 0, sizeof(int)*(nr_counters), &H[0], NULL, profileEvent("read histogram", sizeof(int)*(nr_counters)));
+
+	return makeHistogram(H, layout);
+}
+
+//cumulative distribution of a histogram still on the device, the fraction of all counted values at or below the top edge of every bin
+//the bin counts at the start of buffer_H are scanned in place with the int scan kernels (scan_add_int), so only the running counts come back
+//values under the first bin are below every edge and values over the last bin (and NaN) above all of them
+//levels comes from scanBuffers<cl_int> for layout.nr_bins values
+vector<double> cdfOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel_block, cl::Kernel& kernel_offset, size_t local_size,
+	const cl::Buffer& buffer_H, const BinLayout& layout, const vector<cl::Buffer>& levels)
+{
+	vector<double> cdf(layout.nr_bins);
+	if (!layout.nr_bins)
+		return cdf;
+
+	//underflow and overflow follow the bins, the scan leaves them as they are
+	cl_int outside[2];
+	queue.enqueueReadBuffer(buffer_H, CL_FALSE, layout.nr_bins * sizeof(int), 2 * sizeof(int), outside, NULL, profileEvent("read histogram", 2 * sizeof(int)));
+	vector<cl_int> running = scanOnDevice<cl_int>(queue, kernel_block, kernel_offset, local_size, buffer_H, layout.nr_bins, buffer_H, true, levels);
+
+	double total = (double)outside[0] + running.back() + outside[1];
+	for (int b = 0; b < layout.nr_bins; b++)
+		cdf[b] = total ? (outside[0] + running[b]) / total : 0;
+	return cdf;
+}
+
+//display histogram output in console
+void printHistogram(const Histogram& histogram)
+{
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	std::cout << "Full Data Histogram" << std::endl;
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	cout << "Number of Bins: " << histogram.counts.size() << endl;
+	std::cout << "--------------------------------------------------------------" << std::endl;
+	for (size_t i = 0; i < histogram.counts.size(); i++) {
+		cout << "Bin " << i+1 << " [" << histogram.edges[i] << " to " << histogram.edges[i+1] << "]  " << histogram.counts[i] << endl;
+	}
+	//only mention values outside the bins when there are some
+	if (histogram.underflow)
+		cout << "Below " << histogram.edges.front() << "  " << histogram.underflow << endl;
+	if (histogram.overflow)
+		cout << "Above " << histogram.edges.back() << "  " << histogram.overflow << endl;
+	std::cout << "--------------------------------------------------------------" << std::endl;
+}
+
+//runs one reduction kernel over A, allocating the partial buffers for this call only
+mytype parallelReduce(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A, const char* kernel_name)
 {
-	//create kernel for min reduction
-	cl::Kernel kernel_1 = cl::Kernel(program, "reduce_min");
+	cl::Kernel kernel_1 = cl::Kernel(program, kernel_name);
 
 	//get device and get the max number of work group size recommended
 	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
 	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
 
-	//pad input vector to be multiple of workgroup size as it is more efficient
-	size_t padding_size = A.size() % local_size;
+	size_t nr_groups = std::max(groupCount(A.size(), local_size), (size_t)1);
 
-	//if the input vector is not a multiple of the local_size
-	//insert additional neutral elements (INFINITY for min) so that the top value will be min
-	if (padding_size) {
-		//create an extra vector with neutral values
-		std::vector<float> A_ext(local_size - padding_size, INFINITY);
-		//append that extra vector to our input
-		A.insert(A.end(), A_ext.begin(), A_ext.end());
-	}
+	//device - buffers, no padding needed as the kernel checks bounds, A is read in place where the device allows
+	cl::Buffer buffer_A = inputBuffer(context, device, A);
+	cl::Buffer buffer_B(context, CL_MEM_READ_WRITE, nr_groups * sizeof(mytype));
+	cl::Buffer buffer_C(context, CL_MEM_READ_WRITE, nr_groups * sizeof(mytype));
 
-	size_t input_elements = A.size();//number of input elements after padding
-	size_t input_size = A.size() * sizeof(mytype);//size in bytes after padding
+	return reduceOnDevice(queue, kernel_1, local_size, buffer_A, A.size(), buffer_B, buffer_C);
+}
 
-	//host - output
-	vector<mytype> B(input_elements);
-	size_t output_size = B.size() * sizeof(mytype);//size in bytes of output
-	
-	//Copy vector A to device memory and initialize output
-	cl::Buffer buffer_A(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, input_size, &A);
+//function to find mean of data using opencl kernels
+double parallelMean(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A)
+{
+	//return mean using sum total divided by number of elements
+	return (double)parallelReduce(context, program, queue, A, "reduce_add_6") / A.size();
+}
 
-	//Copy vector A to device memory
-	queue.enqueueWriteBuffer(buffer_A, CL_TRUE, 0, input_size, &A[0]);
+//function to find max of vector using reduction in parallel
+float parallelMax(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A)
+{
+	return parallelReduce(context, program, queue, A, "reduce_max");
+}
 
-	//Setup and execute all kernels (i.e. device code)
-	kernel_1.setArg(0, buffer_A);
-	kernel_1.setArg(1, cl::Local(local_size * sizeof(mytype)));//local memory size
+//function to find min of vector using reduction in parallel
+float parallelMin(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A)
+{
+	return parallelReduce(context, program, queue, A, "reduce_min");
+}
 
-	//call all kernels in a sequence
-	queue.enqueueNDRangeKernel(kernel_1, cl::NullRange, cl::NDRange(A.size()), cl::NDRange(local_size));
+//function to find min, max, sum and count of A in one pass over the data
+Summary parallelSummary(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A)
+{
+	//create kernels for first pass over values and for merging partial summaries
+	cl::Kernel kernel_1 = cl::Kernel(program, "reduce_summary");
+	cl::Kernel kernel_2 = cl::Kernel(program, "reduce_summary_partials");
 
-	//keep calling reduction kernel until input is smaller than workgroup size
-	//this means that the first element will be the max of the vector
-	while (input_elements / local_size > local_size) {
-		input_elements = input_elements / local_size;
+	//get device and get the max number of work group size recommended
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	local_size = std::min(local_size, kernel_2.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
 
-		size_t padding_size2 = input_elements % local_size;
+	size_t nr_groups = std::max(groupCount(A.size(), local_size), (size_t)1);
 
-		//if the input vector is not a multiple of the local_size
-		//then add to input size and make the added element 0
-		if (padding_size2) {
-			//read the buffer back into A
-			queue.enqueueReadBuffer(buffer_A, CL_TRUE, 0, output_size, &A[0]);
-			size_t neededElements = local_size - padding_size2;
+	//device - buffers, two partial buffers so each level reads one and writes the other
+	cl::Buffer buffer_A = inputBuffer(context, device, A);
+	cl::Buffer buffer_B(context, CL_MEM_READ_WRITE, nr_groups * sizeof(Summary));
+	cl::Buffer buffer_C(context, CL_MEM_READ_WRITE, nr_groups * sizeof(Summary));
 
-			//set netural values for current input size
-			for (auto i = A.begin() + input_elements; i != (A.begin() + input_elements + neededElements); i++) {
-				*i = INFINITY; //neutral value for min is INFINITY
-			}
+	return summaryOnDevice(queue, kernel_1, kernel_2, local_size, buffer_A, A.size(), buffer_B, buffer_C);
+}
 
-			input_elements = input_elements + neededElements;
+//function to find the mean, variance, standard deviation, skewness and kurtosis of A in one pass over the data
+Moments parallelMoments(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A)
+{
+	//create kernels for the Welford pass over the values and for merging partial moments
+	cl::Kernel kernel_1 = cl::Kernel(program, "reduce_moments");
+	cl::Kernel kernel_2 = cl::Kernel(program, "reduce_moments_partials");
 
-			//write A back to buffer
-			queue.enqueueWriteBuffer(buffer_A, CL_TRUE, 0, input_size, &A[0]);
-		}
-		//execute kernal on device
-		queue.enqueueNDRangeKernel(kernel_1, cl::NullRange, cl::NDRange(input_elements), cl::NDRange(local_size));
-	}
+	//get device and get the max number of work group size recommended, power of two for the sequential addressing
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	local_size = powerOfTwoFloor(std::min(local_size, kernel_2.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device)));
 
-	//do final reduction, this time first element will be max value
-	queue.enqueueReadBuffer(buffer_A, CL_TRUE, 0, output_size, &A[0]);
-	size_t start = input_elements / local_size;
-	for (auto i = A.begin() + start; i != (A.begin() + local_size); i++) {
-		*i = INFINITY; //neutral value for min is INFINITY
-	}
-	input_elements = local_size;
-	queue.enqueueWriteBuffer(buffer_A, CL_TRUE, 0, input_size, &A[0]);
-	queue.enqueueNDRangeKernel(kernel_1, cl::NullRange, cl::NDRange(input_elements), cl::NDRange(local_size));
+	size_t nr_groups = std::max(groupCount(A.size(), local_size), (size_t)1);
 
-	//read the buffer A from device to host vector B
-	queue.enqueueReadBuffer(buffer_A, CL_TRUE, 0, output_size, &B[0]);
+	cl::Buffer buffer_A = inputBuffer(context, device, A);
+	cl::Buffer buffer_B(context, CL_MEM_READ_WRITE, nr_groups * sizeof(Moments));
+	cl::Buffer buffer_C(context, CL_MEM_READ_WRITE, nr_groups * sizeof(Moments));
 
-	return B[0];
+	return momentsOnDevice(queue, kernel_1, kernel_2, local_size, buffer_A, A.size(), buffer_B, buffer_C);
 }
 
-//function to create histogram using number of bins in parallel
-void parallelHistogram(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, vector<mytype> A, int & nr_bins)
+//function to sort A on the device, returns the sorted copy
+vector<mytype> parallelSort(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A)
 {
+	cl::Kernel kernel_1 = cl::Kernel(program, "sort_bitonic_step");
+	cl::Kernel kernel_2 = cl::Kernel(program, "sort_bitonic_local");
+
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	local_size = std::min(local_size, kernel_2.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
 
-	float min = floor(parallelMin(context, program, queue, A)); //find min value and round down
-	float max = (ceil(parallelMax(context, program, queue, A))) + 1; // find max value and round up then add 1 so all value are counted
+	vector<mytype> sorted(A.begin(), A.end());
+	if (sorted.size() < 2)
+		return sorted;
 
-	float range = max - min; // find range of data set
-	float bin_width = range / nr_bins; // find width of each bin by dividing range by number of bins wanted
+	//the sort works in place on a power of two sized copy
+	cl::Buffer buffer_A(context, CL_MEM_READ_WRITE, powerOfTwoCeil(A.size()) * sizeof(mytype));
+	queue.enqueueWriteBuffer(buffer_A, CL_FALSE, 0, A.size() * sizeof(mytype), A.data(), NULL, profileEvent("write", A.size() * sizeof(mytype)));
+	sortOnDevice(queue, kernel_1, kernel_2, local_size, buffer_A, A.size());
+	queue.enqueueReadBuffer(buffer_A, CL_TRUE, 0, A.size() * sizeof(mytype), &sorted[0], NULL, profileEvent("read", A.size() * sizeof(mytype)));
 
-	//create kernel for parallel histogram
-	cl::Kernel kernel_1 = cl::Kernel(program, "hist_atomic");
+	return sorted;
+}
+
+//function to find the running sum, min or max of A in order, e.g. the coldest reading so far at every reading
+//inclusive counts each value in its own result, exclusive only the values before it
+vector<mytype> parallelScan(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A, ReduceOp op, bool inclusive = true)
+{
+	cl::Kernel kernel_1 = cl::Kernel(program, scanKernelName(op));
+	cl::Kernel kernel_2 = cl::Kernel(program, scanOffsetKernelName(op));
 
-	//get device and get the max work group size recommended
 	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
 	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	local_size = powerOfTwoFloor(std::min(local_size, kernel_2.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device))); //the block scan needs a power of two
 
+	if (A.empty())
+		return vector<mytype>();
 
-	size_t padding_size = A.size() % local_size;
+	//scanned in place on a copy
+	cl::Buffer buffer_A(context, CL_MEM_READ_WRITE, A.size() * sizeof(mytype));
+	queue.enqueueWriteBuffer(buffer_A, CL_FALSE, 0, A.size() * sizeof(mytype), A.data(), NULL, profileEvent("write", A.size() * sizeof(mytype)));
+	vector<cl::Buffer> levels = scanBuffers<mytype>(context, A.size(), local_size);
 
-	//if the input vector is not a multiple of the local_size
-	//insert additional neutral elements (max+1 for histogram as it will be outside the bins) so that the histogram will not be affected
-	if (padding_size) {
-		//create an extra vector with neutral values
-		std::vector<float> A_ext(local_size - padding_size, max + 1);
-		//append that extra vector to our input
-		A.insert(A.end(), A_ext.begin(), A_ext.end());
-	}
+	return scanOnDevice<mytype>(queue, kernel_1, kernel_2, local_size, buffer_A, A.size(), buffer_A, inclusive, levels);
+}
 
-	size_t input_elements = A.size();//number of input elements
-	size_t input_size = A.size() * sizeof(mytype);//size in bytes
+//function to find the moving mean, min and max of A over every window of w consecutive values
+Rolling parallelRolling(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A, int w)
+{
+	cl::Kernel kernel_1 = cl::Kernel(program, "rolling_blocks");
+	cl::Kernel kernel_2 = cl::Kernel(program, "rolling_windows");
 
-	vector<int> H(nr_bins); // create out put host vector for histogram
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	local_size = std::min(local_size, kernel_2.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
 
-	//device - buffers
-	cl::Buffer buffer_A(context, CL_MEM_READ_WRITE, input_size);
-	cl::Buffer buffer_bins(context, CL_MEM_READ_WRITE, sizeof(int));
-	cl::Buffer buffer_width(context, CL_MEM_READ_WRITE, sizeof(float));
-	cl::Buffer buffer_min(context, CL_MEM_READ_WRITE, sizeof(float));
-	cl::Buffer buffer_H(context, CL_MEM_READ_WRITE, sizeof(int)*(nr_bins));
+	size_t nr_windows = rollingWindows(A.size(), w);
+	if (!nr_windows)
+		throw cl::Error(CL_INVALID_VALUE, "Rolling window must be between 1 and the number of values");
 
-	//Write data to buffer and initialize output buffer
-	queue.enqueueWriteBuffer(buffer_A, CL_TRUE, 0, input_size, &A[0]);
-	queue.enqueueWriteBuffer(buffer_bins, CL_TRUE, 0, sizeof(int), &nr_bins);
-	queue.enqueueWriteBuffer(buffer_width, CL_TRUE, 0, sizeof(float), &bin_width);
-	queue.enqueueWriteBuffer(buffer_min, CL_TRUE, 0, sizeof(float), &min);
-	queue.enqueueFillBuffer(buffer_H, 0, 0, sizeof(int)*(nr_bins));//zero B buffer on device memory
+	cl::Buffer buffer_A = inputBuffer(context, device, A);
+	cl::Buffer buffer_G(context, CL_MEM_READ_WRITE, 3 * A.size() * sizeof(mytype));
+	cl::Buffer buffer_H(context, CL_MEM_READ_WRITE, 3 * A.size() * sizeof(mytype));
+	cl::Buffer buffer_R(context, CL_MEM_READ_WRITE, 3 * nr_windows * sizeof(mytype));
 
-	//Setup and execute all kernels (i.e. device code)
-	kernel_1.setArg(0, buffer_A);
-	kernel_1.setArg(1, buffer_bins);
-	kernel_1.setArg(2, buffer_width);
-	kernel_1.setArg(3, buffer_min);
-	kernel_1.setArg(4, buffer_H);
+	return rollingOnDevice(queue, kernel_1, kernel_2, local_size, buffer_A, A.size(), w, buffer_G, buffer_H, buffer_R);
+}
 
-	queue.enqueueNDRangeKernel(kernel_1, cl::NullRange, cl::NDRange(A.size()), cl::NDRange(local_size));
+//function to find the values at fractions ps of the sorted data, e.g. {0.05, 0.5, 0.95} for p5, median and p95
+//uses radix select for each rank so nothing is sorted
+vector<double> parallelPercentiles(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A, const vector<double>& ps)
+{
+	cl::Kernel kernel_1 = cl::Kernel(program, "radix_select_hist");
 
-	//read buffer_H into host code vector H
-	queue.enqueueReadBuffer(buffer_H, CL_TRUE, 0, sizeof(int)*(nr_bins), &H[0]);
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	size_t nr_groups = std::max(std::min(groupCount(A.size(), local_size), (size_t)device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() * 16), (size_t)1);
 
-	//display output in console using vector H
-	std::cout << "--------------------------------------------------------------" << std::endl;
-	std::cout << "Full Data Histogram" << std::endl;
-	std::cout << "--------------------------------------------------------------" << std::endl;
-	cout << "Number of Bins: " << nr_bins << endl;
-	std::cout << "--------------------------------------------------------------" << std::endl;
-	for (int i = 0; i < H.size(); i++) {
-		cout << "Bin " << i+1 << " [" << ((i*bin_width) + min) << " to " << (((i+1)*bin_width) + min) << "]  " << H[i] << endl;
-	}
-	std::cout << "--------------------------------------------------------------" << std::endl;
+	cl::Buffer buffer_A = inputBuffer(context, device, A);
+	cl::Buffer buffer_H(context, CL_MEM_READ_WRITE, 256 * sizeof(cl_uint));
 
+	return percentilesOnDevice(queue, kernel_1, local_size, nr_groups, buffer_A, A.size(), ps, buffer_H);
 }
 
-/*void normalHist(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, vector<mytype> A, int & nr_bins)
+//function to create a histogram with any bin layout in parallel, returned instead of printed
+Histogram parallelHistogram(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A, const BinLayout& layout)
 {
-	float min = floor(parallelMin(context, program, queue, A)); //find min value and round
-	float max = (ceil(parallelMax(context, program, queue, A))) + 1; // find max value and round up then add 1 so value is counted
+	cl::Kernel kernel_1 = cl::Kernel(program, "hist_atomic");
+	cl::Kernel kernel_2 = cl::Kernel(program, "hist_local");
 
-	float range = max - min; // find range of data set
-	float bin_width = range / nr_bins; // find width of each bin by dividing range by number of bins wanted
-	vector<int> H(nr_bins);
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	local_size = std::min(local_size, kernel_2.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
 
-	for (int i = 0; i < A.size(); i++) {
-		int index = ((A[i] - min) / bin_width);
-		if (index >= nr_bins || index < 0)
-		{
-			index = nr_bins;
-		}
-		H[index]++;
-	}
+	cl::Buffer buffer_A = inputBuffer(context, device, A);
+	cl::Buffer buffer_edges = edgesBuffer(context, device, layout);
+	cl::Buffer buffer_H(context, CL_MEM_READ_WRITE, sizeof(int)*histogramCounters(layout));
+
+	int copies = histogramCopies(device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>(), layout, local_size);
+	if (copies)
+		return histogramLocalOnDevice(queue, kernel_2, local_size, device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() * 16, buffer_A, A.size(), layout, copies, buffer_edges, buffer_H);
+	return histogramOnDevice(queue, kernel_1, local_size, buffer_A, A.size(), layout, buffer_edges, buffer_H);
+}
+
+//function to create histogram using number of bins in parallel
+void parallelHistogram(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A, int & nr_bins)
+{
+	//create kernels for the min/max pass and for the histogram
+	cl::Kernel kernel_1 = cl::Kernel(program, "reduce_summary");
+	cl::Kernel kernel_2 = cl::Kernel(program, "reduce_summary_partials");
+	cl::Kernel kernel_3 = cl::Kernel(program, "hist_atomic");
+	cl::Kernel kernel_4 = cl::Kernel(program, "hist_local");
+
+	//get device and get the max work group size recommended
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	local_size = std::min(local_size, kernel_2.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+	local_size = std::min(local_size, kernel_3.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+	local_size = std::min(local_size, kernel_4.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+
+	size_t nr_groups = std::max(groupCount(A.size(), local_size), (size_t)1);
+
+	//device - buffers, the data is uploaded at most once and used for both the min/max and histogram kernels
+	cl::Buffer buffer_A = inputBuffer(context, device, A);
+	cl::Buffer buffer_B(context, CL_MEM_READ_WRITE, nr_groups * sizeof(Summary));
+	cl::Buffer buffer_C(context, CL_MEM_READ_WRITE, nr_groups * sizeof(Summary));
+
+	Summary summary = summaryOnDevice(queue, kernel_1, kernel_2, local_size, buffer_A, A.size(), buffer_B, buffer_C);
+	float min = floor(summary.min); //find min value and round down
+	float max = (ceil(summary.max)) + 1; // find max value and round up then add 1 so the bins have whole number edges past the max
+
+	BinLayout layout = uniformBins(min, max, nr_bins);
+	cl::Buffer buffer_edges = edgesBuffer(context, device, layout);
+	cl::Buffer buffer_H(context, CL_MEM_READ_WRITE, sizeof(int)*histogramCounters(layout));
+
+	//use local sub-histograms when the bins fit in local memory, otherwise one global atomic per element
+	int copies = histogramCopies(device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>(), layout, local_size);
+	Histogram H;
+	if (copies)
+		H = histogramLocalOnDevice(queue, kernel_4, local_size, device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() * 16, buffer_A, A.size(), layout, copies, buffer_edges, buffer_H);
+	else
+		H = histogramOnDevice(queue, kernel_3, local_size, buffer_A, A.size(), layout, buffer_edges, buffer_H);
+
+	printHistogram(H);
+}
 
-	for (int c = 0; c < H.size(); c++) {
-		cout << "Bin " << c + 1 << " [" << ((c*bin_width) + min) << " to " << (((c + 1)*bin_width) + min) << "]  " << H[c] << endl;
+//bin of one value for layout, the same rules as the histogram kernels (underflow at nr_bins, overflow and NaN at nr_bins + 1)
+int normalBin(float val, const BinLayout& layout)
+{
+	int nr_bins = layout.nr_bins;
+	if (layout.edges.empty()) {
+		float pos = (val - layout.min) / layout.bin_width;
+		if (pos < 0)
+			return nr_bins;
+		if (!(pos < nr_bins))
+			return nr_bins + 1;
+		return (int)pos;
 	}
-}*/
+	if (val < layout.edges[0])
+		return nr_bins;
+	if (!(val <= layout.edges[nr_bins]))
+		return nr_bins + 1;
+	//largest i with edges[i] <= val, the top edge belongs to the last bin
+	int i = (int)(std::upper_bound(layout.edges.begin(), layout.edges.end(), val) - layout.edges.begin()) - 1;
+	return std::min(i, nr_bins - 1);
+}
+
+//check function for histogram in sequential programming
+Histogram normalHist(DataView A, const BinLayout& layout)
+{
+	vector<int> H(histogramCounters(layout));
+	for (size_t i = 0; i < A.size(); i++)
+		H[normalBin(A[i], layout)]++;
+
+	return makeHistogram(H, layout);
+}
 
 //check function for mean in seqential programming
-double normalMean(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, vector<mytype> A)
+double normalMean(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A)
 {
 
 	double sum = 0;
@@ -384,4 +1159,69 @@ double normalMean(cl::Context& context, cl::Program & program, cl::CommandQueue&
 	}
 
 	return sum/A.size() ;
-}
\ No newline at end of file
+}
+
+//reference mean the precision modes are checked against, a Neumaier compensated sum in long double
+//so its error stays far below the tightest MeanPrecision tolerance whatever the data size
+double accurateMean(DataView A)
+{
+	long double sum = 0, compensation = 0;
+	for (size_t i = 0; i < A.size(); i++) {
+		long double t = sum + A[i];
+		if (fabsl(sum) >= fabsl((long double)A[i]))
+			compensation += (sum - t) + A[i];
+		else
+			compensation += ((long double)A[i] - t) + sum;
+		sum = t;
+	}
+	return (double)((sum + compensation) / A.size());
+}
+
+//check function for scan in sequential programming
+vector<mytype> normalScan(DataView A, ReduceOp op, bool inclusive = true)
+{
+	vector<mytype> result(A.size());
+	mytype acc = (op == REDUCE_ADD) ? 0.0f : ((op == REDUCE_MIN) ? INFINITY : -INFINITY);
+	for (size_t i = 0; i < A.size(); i++) {
+		if (!inclusive)
+			result[i] = acc;
+		acc = (op == REDUCE_ADD) ? acc + A[i] : ((op == REDUCE_MIN) ? std::min(acc, A[i]) : std::max(acc, A[i]));
+		if (inclusive)
+			result[i] = acc;
+	}
+	return result;
+}
+
+//check function for rolling windows in sequential programming, a running double sum and monotonic queues of candidate min and max positions
+Rolling normalRolling(DataView A, int w)
+{
+	Rolling rolling;
+	rolling.window = w;
+	if (!rollingWindows(A.size(), w))
+		return rolling;
+
+	std::deque<size_t> lows, highs;
+	double sum = 0;
+	for (size_t i = 0; i < A.size(); i++) {
+		sum += A[i];
+		while (!lows.empty() && (A[lows.back()] >= A[i]))
+			lows.pop_back();
+		lows.push_back(i);
+		while (!highs.empty() && (A[highs.back()] <= A[i]))
+			highs.pop_back();
+		highs.push_back(i);
+
+		if (i + 1 < (size_t)w)
+			continue;
+		size_t k = i + 1 - w; //first value of the window ending at i
+		if (lows.front() < k)
+			lows.pop_front();
+		if (highs.front() < k)
+			highs.pop_front();
+		rolling.mean.push_back((float)(sum / w));
+		rolling.min.push_back(A[lows.front()]);
+		rolling.max.push_back(A[highs.front()]);
+		sum -= A[k];
+	}
+	return rolling;
+}
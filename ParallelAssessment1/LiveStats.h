@@ -0,0 +1,203 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "Functions.h"
+#include "StatsEngine.h"
+#include "Streaming.h"
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+//a series that keeps growing on the device, e.g. the readings every station pushes every few minutes
+//append uploads only the new values and reduces just those, folding the result into summaries kept on the host
+//(overall and per month) and into the counts of every registered histogram, so the queries never touch the history again
+class LiveStats {
+public:
+	//room for initial_capacity values to start with, the series doubles whenever an append does not fit
+	LiveStats(StatsEngine& engine, size_t initial_capacity = 1 << 16)
+		: engine(engine), nr_values(0), series_capacity(std::max(initial_capacity, (size_t)1)), delta_capacity(0), keyed_capacity(0), nr_appends(0),
+		month_summaries(12)
+	{
+		cl::Context& context = engine.getContext();
+		kernel_summary_by_key = cl::Kernel(engine.getProgram(), "reduce_summary_by_key");
+		kernel_hist = cl::Kernel(engine.getProgram(), "hist_atomic");
+		kernel_hist_local = cl::Kernel(engine.getProgram(), "hist_local");
+
+		series = cl::Buffer(context, CL_MEM_READ_WRITE, series_capacity * sizeof(mytype));
+		series_keys = cl::Buffer(context, CL_MEM_READ_WRITE, series_capacity * sizeof(cl_uchar));
+	}
+
+	//keep a histogram with this layout up to date from now on, returns the id to pass to histogram
+	//values already appended are counted once here, later appends only count their own values
+	int addHistogram(const BinLayout& layout)
+	{
+		cl::Context& context = engine.getContext();
+		cl::CommandQueue& queue = engine.getQueue();
+
+		LiveHistogram live;
+		live.layout = layout;
+		live.counts.assign(histogramCounters(layout), 0);
+		live.buffer_H = cl::Buffer(context, CL_MEM_READ_WRITE, live.counts.size() * sizeof(int));
+		live.buffer_edges = edgesBuffer(context, engine.getDevice(), layout);
+		live.copies = (engine.getHistogramMethod() == HIST_GLOBAL) ? 0 : histogramCopies(engine.getLocalMemSize(), layout, engine.getLocalSize());
+
+		queue.enqueueFillBuffer(live.buffer_H, 0, 0, live.counts.size() * sizeof(int), NULL, profileEvent("fill", live.counts.size() * sizeof(int)));
+		histograms.push_back(live);
+		if (nr_values) {
+			enqueueCount(histograms.back(), series, nr_values);
+			queue.enqueueReadBuffer(histograms.back().buffer_H, CL_TRUE, 0, live.counts.size() * sizeof(int), &histograms.back().counts[0], NULL,
+				profileEvent("read histogram", live.counts.size() * sizeof(int)));
+		}
+		return (int)histograms.size() - 1;
+	}
+
+	//adds nr_elements new values with their months (1-12), only these are uploaded and reduced
+	//the values can be reused as soon as this returns
+	//every month has to be 1 to 12, otherwise nothing is added and cl::Error is thrown, as the keyed pass the summaries come from
+	//skips other keys while the histograms would still count those values
+	void append(const mytype* values, const cl_uchar* months, size_t nr_elements)
+	{
+		if (!nr_elements)
+			return;
+		for (size_t i = 0; i < nr_elements; i++)
+			if ((months[i] < 1) || (months[i] > 12))
+				throw cl::Error(CL_INVALID_VALUE, "Every appended value needs a month from 1 to 12");
+
+		cl::Context& context = engine.getContext();
+		cl::CommandQueue& queue = engine.getQueue();
+		size_t local_size = engine.getLocalSize();
+
+		reserve(nr_values + nr_elements);
+		reserveDelta(nr_elements);
+
+		//the new values go up once, into the delta buffers the kernels read, and are copied on the device to the end of the series
+		queue.enqueueWriteBuffer(delta, CL_FALSE, 0, nr_elements * sizeof(mytype), values, NULL, profileEvent("write", nr_elements * sizeof(mytype)));
+		queue.enqueueWriteBuffer(delta_keys, CL_FALSE, 0, nr_elements * sizeof(cl_uchar), months, NULL, profileEvent("write", nr_elements * sizeof(cl_uchar)));
+		queue.enqueueCopyBuffer(delta, series, 0, nr_values * sizeof(mytype), nr_elements * sizeof(mytype), NULL,
+			profileEvent("copy", nr_elements * sizeof(mytype)));
+		queue.enqueueCopyBuffer(delta_keys, series_keys, 0, nr_values * sizeof(cl_uchar), nr_elements * sizeof(cl_uchar), NULL,
+			profileEvent("copy", nr_elements * sizeof(cl_uchar)));
+
+		//every month of the delta in one keyed pass, the partials are folded on the host
+		size_t nr_groups = std::max(std::min(groupCount(nr_elements, local_size), engine.getComputeUnits() * 8), (size_t)1);
+		if (nr_groups * 12 > keyed_capacity) {
+			buffer_keyed = cl::Buffer(context, CL_MEM_READ_WRITE, nr_groups * 12 * sizeof(Summary));
+			keyed_capacity = nr_groups * 12;
+		}
+		enqueueSummaryByKey(queue, kernel_summary_by_key, local_size, nr_groups, delta, delta_keys, nr_elements, 12, buffer_keyed);
+		vector<Summary> partials(nr_groups * 12);
+		queue.enqueueReadBuffer(buffer_keyed, CL_FALSE, 0, partials.size() * sizeof(Summary), &partials[0], NULL,
+			profileEvent("read partials", partials.size() * sizeof(Summary)));
+
+		//registered histograms count the delta on top of what they already hold
+		for (size_t h = 0; h < histograms.size(); h++) {
+			enqueueCount(histograms[h], delta, nr_elements);
+			queue.enqueueReadBuffer(histograms[h].buffer_H, CL_FALSE, 0, histograms[h].counts.size() * sizeof(int), &histograms[h].counts[0], NULL,
+				profileEvent("read histogram", histograms[h].counts.size() * sizeof(int)));
+		}
+
+		//the only wait of an append, after it the host copies are current
+		queue.finish();
+
+		vector<Summary> months_added = mergeKeyedSummaries(partials, nr_groups, 12);
+		for (int m = 0; m < 12; m++) {
+			month_summaries[m].add(months_added[m]);
+			total.add(months_added[m]);
+		}
+		nr_values += nr_elements;
+		nr_appends++;
+	}
+
+	void append(const DataChunk& chunk)
+	{
+		append(chunk.values.data(), chunk.months.data(), chunk.values.size());
+	}
+
+	//queries, all answered from the host copies without touching the device
+	const RunningSummary& summary() const { return total; }
+	const RunningSummary& month(int m) const { return month_summaries[m - 1]; } //m 1-12
+	Histogram histogram(int id) const { return makeHistogram(histograms[id].counts, histograms[id].layout); }
+
+	size_t size() const { return nr_values; }
+	size_t capacity() const { return series_capacity; }
+	size_t appends() const { return nr_appends; }
+
+	//the whole series and its months on the device, valid until the next append that has to grow them
+	const cl::Buffer& values() const { return series; }
+	const cl::Buffer& keys() const { return series_keys; }
+
+private:
+	//counts on the device for one registered layout, adding up over every append
+	struct LiveHistogram {
+		BinLayout layout;
+		int copies; //local sub-histograms, 0 for the global kernel
+		cl::Buffer buffer_H, buffer_edges;
+		vector<int> counts; //host copy, current after every append
+	};
+
+	//enqueues the histogram kernel over the first nr_elements values of buffer_A without clearing the counts
+	void enqueueCount(LiveHistogram& live, const cl::Buffer& buffer_A, size_t nr_elements)
+	{
+		cl::CommandQueue& queue = engine.getQueue();
+		size_t local_size = engine.getLocalSize();
+		if (live.copies)
+			enqueueHistogramLocal(queue, kernel_hist_local, local_size, engine.getComputeUnits() * 16, buffer_A, nr_elements, live.layout, live.copies,
+				live.buffer_edges, live.buffer_H);
+		else
+			enqueueHistogram(queue, kernel_hist, local_size, buffer_A, nr_elements, live.layout, live.buffer_edges, live.buffer_H);
+	}
+
+	//grows the series to hold nr_elements values, at least doubling so appends cost amortised O(1) copies per value
+	//the history moves on the device, nothing is uploaded again
+	void reserve(size_t nr_elements)
+	{
+		if (nr_elements <= series_capacity)
+			return;
+
+		cl::Context& context = engine.getContext();
+		cl::CommandQueue& queue = engine.getQueue();
+		size_t capacity = std::max(nr_elements, 2 * series_capacity);
+		cl::Buffer grown(context, CL_MEM_READ_WRITE, capacity * sizeof(mytype));
+		cl::Buffer grown_keys(context, CL_MEM_READ_WRITE, capacity * sizeof(cl_uchar));
+		if (nr_values) {
+			queue.enqueueCopyBuffer(series, grown, 0, 0, nr_values * sizeof(mytype), NULL, profileEvent("copy", nr_values * sizeof(mytype)));
+			queue.enqueueCopyBuffer(series_keys, grown_keys, 0, 0, nr_values * sizeof(cl_uchar), NULL, profileEvent("copy", nr_values * sizeof(cl_uchar)));
+		}
+		series = grown;
+		series_keys = grown_keys;
+		series_capacity = capacity;
+	}
+
+	//room for one append of nr_elements values, kept for later appends
+	void reserveDelta(size_t nr_elements)
+	{
+		if (nr_elements <= delta_capacity)
+			return;
+
+		cl::Context& context = engine.getContext();
+		delta = cl::Buffer(context, CL_MEM_READ_WRITE, nr_elements * sizeof(mytype));
+		delta_keys = cl::Buffer(context, CL_MEM_READ_WRITE, nr_elements * sizeof(cl_uchar));
+		delta_capacity = nr_elements;
+	}
+
+	StatsEngine& engine;
+	cl::Kernel kernel_summary_by_key, kernel_hist, kernel_hist_local;
+	cl::Buffer series, series_keys; //every value so far, then room to grow
+	size_t nr_values;
+	size_t series_capacity;
+	cl::Buffer delta, delta_keys; //values of the current append
+	size_t delta_capacity;
+	cl::Buffer buffer_keyed; //per group partial summaries of the delta
+	size_t keyed_capacity;
+	size_t nr_appends;
+
+	RunningSummary total;
+	vector<RunningSummary> month_summaries;
+	vector<LiveHistogram> histograms;
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+
+#include "Functions.h"
+#include "StatsEngine.h"
+#include "Streaming.h"
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+//every device of every platform, with split_cpus CPU devices that can be partitioned are split by affinity domain
+//(e.g. one sub-device per NUMA node) so each part works on memory close to it
+vector<cl::Device> allDevices(bool split_cpus = false)
+{
+	vector<cl::Device> result;
+	vector<cl::Platform> platforms;
+	cl::Platform::get(&platforms);
+
+	for (size_t i = 0; i < platforms.size(); i++) {
+		vector<cl::Device> devices;
+		platforms[i].getDevices((cl_device_type)CL_DEVICE_TYPE_ALL, &devices);
+
+		for (size_t j = 0; j < devices.size(); j++) {
+			if (split_cpus && (devices[j].getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU) && (devices[j].getInfo<CL_DEVICE_PARTITION_MAX_SUB_DEVICES>() > 1)) {
+				cl_device_partition_property properties[] = { CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE, 0 };
+				vector<cl::Device> sub_devices;
+				try {
+					devices[j].createSubDevices(properties, &sub_devices);
+				}
+				catch (const cl::Error&) {
+					sub_devices.clear(); //only one affinity domain, or the runtime cannot split this way
+				}
+				if (sub_devices.size() > 1) {
+					result.insert(result.end(), sub_devices.begin(), sub_devices.end());
+					continue;
+				}
+			}
+			result.push_back(devices[j]);
+		}
+	}
+	return result;
+}
+
+//share of the data a device's slice may drift from its throughput share before the data is split again
+#define REBALANCE_THRESHOLD 0.05
+
+//splits one dataset over several devices, each with its own context, kernels and queue
+//queries run on every device at the same time and the partial results are merged on the host,
+//each device's slice is sized by how fast it got through its last query, so a slow device does not hold up the rest
+class MultiDeviceStats {
+public:
+	MultiDeviceStats() : has_summary(false) {}
+
+	//builds the kernels on every device, throughput starts as compute units x clock until a query has been timed
+	void init(const vector<cl::Device>& devices, const string& kernel_file = "my_kernels.cl")
+	{
+		if (devices.empty())
+			throw cl::Error(CL_DEVICE_NOT_FOUND, "No OpenCL devices to share the work between");
+
+		parts.clear();
+		parts.resize(devices.size());
+		for (size_t i = 0; i < devices.size(); i++) {
+			DevicePart& part = parts[i];
+			part.engine.init(cl::Context(devices[i]), kernel_file);
+			part.name = devices[i].getInfo<CL_DEVICE_NAME>().c_str();
+			part.in_place = sharesHostMemory(devices[i]);
+			part.throughput = (double)devices[i].getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() * std::max(devices[i].getInfo<CL_DEVICE_MAX_CLOCK_FREQUENCY>(), 1u);
+			part.measured = false;
+			part.id = -1;
+			part.begin = part.count = 0;
+			part.last_ms = 0;
+		}
+	}
+
+	//split A over the devices, A has to stay valid and unchanged as devices that share host memory read it in place
+	void setData(DataView A)
+	{
+		data = A;
+		has_summary = false;
+		partition();
+	}
+
+	//min, max, sum and count of the whole dataset, worked out once and then remembered
+	//the slices are merged in a RunningSummary, so the total keeps a double sum and a size_t count however large the data
+	RunningSummary summary()
+	{
+		if (!has_summary) {
+			vector<Summary> partials(parts.size(), emptySummary());
+			runOnDevices([&](size_t i) { partials[i] = parts[i].engine.summary(parts[i].id); });
+
+			whole_summary = RunningSummary();
+			for (size_t i = 0; i < partials.size(); i++)
+				whole_summary.add(partials[i]);
+			has_summary = true;
+		}
+		return whole_summary;
+	}
+
+	//mean of the whole dataset, each device's mean weighted by its slice, in the engines' mean precision
+	double mean()
+	{
+		//sums are taken inside the query as the slices may be resized straight after it
+		vector<double> sums(parts.size(), 0);
+		runOnDevices([&](size_t i) { sums[i] = parts[i].engine.mean(parts[i].id) * parts[i].count; });
+
+		double total = 0;
+		for (size_t i = 0; i < parts.size(); i++)
+			total += sums[i];
+		return total / data.size();
+	}
+
+	//histogram of the whole dataset, every device bins its slice and the counts are added up
+	Histogram histogram(const BinLayout& layout)
+	{
+		vector<Histogram> partials(parts.size());
+		runOnDevices([&](size_t i) { partials[i] = parts[i].engine.histogram(parts[i].id, layout); });
+
+		vector<int> H(histogramCounters(layout), 0);
+		for (size_t i = 0; i < parts.size(); i++) {
+			if (partials[i].counts.empty())
+				continue; //device had no slice
+			for (int b = 0; b < layout.nr_bins; b++)
+				H[b] += partials[i].counts[b];
+			H[layout.nr_bins] += partials[i].underflow;
+			H[layout.nr_bins + 1] += partials[i].overflow;
+		}
+		return makeHistogram(H, layout);
+	}
+
+	//histogram with nr_bins equal width bins between the rounded min and max, as StatsEngine::histogram
+	Histogram histogram(int nr_bins)
+	{
+		RunningSummary s = summary();
+		return histogram(uniformBins(floor(s.min), ceil(s.max) + 1, nr_bins));
+	}
+
+	//each device's slice and how fast its last query ran
+	void printDevices(std::ostream& out) const
+	{
+		out << "--------------------------------------------------------------" << std::endl;
+		out << std::left << std::setw(40) << "device" << std::setw(10) << "share" << std::setw(12) << "last [ms]" << "Melem/s" << std::endl;
+		for (size_t i = 0; i < parts.size(); i++) {
+			const DevicePart& part = parts[i];
+			out << std::setw(40) << part.name.substr(0, 39) << std::setw(10) << 100.0 * part.count / std::max(data.size(), (size_t)1)
+				<< std::setw(12) << part.last_ms << (part.measured ? part.throughput / 1e6 : 0) << std::endl;
+		}
+		out << "--------------------------------------------------------------" << std::endl;
+		out << std::right;
+	}
+
+	size_t nrDevices() const { return parts.size(); }
+
+private:
+	struct DevicePart {
+		StatsEngine engine;
+		string name;
+		bool in_place; //slice read straight from host memory
+		double throughput; //elements per second of the last queries, relative only until measured
+		bool measured;
+		int id; //dataset id in engine, -1 before the first split
+		size_t begin, count; //slice of the data
+		double last_ms;
+	};
+
+	//runs query(i) for every device with a slice at the same time, one host thread per device (each has its own queue),
+	//then updates the throughputs and splits the data again if they moved too far from the slices
+	template <typename F>
+	void runOnDevices(F query)
+	{
+		vector<std::thread> threads;
+		vector<std::exception_ptr> failures(parts.size());
+		for (size_t i = 0; i < parts.size(); i++) {
+			if (!parts[i].count)
+				continue;
+			threads.push_back(std::thread([&, i]() {
+				try {
+					auto start = std::chrono::high_resolution_clock::now();
+					query(i);
+					auto end = std::chrono::high_resolution_clock::now();
+					parts[i].last_ms = std::chrono::duration<double, std::milli>(end - start).count();
+				}
+				catch (...) {
+					failures[i] = std::current_exception();
+				}
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		for (size_t i = 0; i < failures.size(); i++)
+			if (failures[i])
+				std::rethrow_exception(failures[i]);
+
+		rebalance();
+	}
+
+	//folds the last query's times into the throughputs, half old and half new so one noisy run does not swing the split
+	void rebalance()
+	{
+		for (size_t i = 0; i < parts.size(); i++) {
+			DevicePart& part = parts[i];
+			if (!part.count || !(part.last_ms > 0))
+				continue;
+			double measured = part.count / (part.last_ms / 1e3);
+			part.throughput = part.measured ? (part.throughput + measured) / 2 : measured;
+			part.measured = true;
+		}
+
+		//devices that have not run yet cannot be compared with ones that have, so wait until every device is measured
+		vector<size_t> target = sliceSizes();
+		double drift = 0;
+		for (size_t i = 0; i < parts.size(); i++) {
+			if (!parts[i].measured && parts[i].count)
+				return;
+			drift = std::max(drift, fabs((double)target[i] - (double)parts[i].count));
+		}
+		if (drift > REBALANCE_THRESHOLD * data.size())
+			partition();
+	}
+
+	//slice of each device in proportion to its throughput, the rounding left over goes to the last device
+	vector<size_t> sliceSizes() const
+	{
+		double total = 0;
+		for (size_t i = 0; i < parts.size(); i++)
+			total += parts[i].throughput;
+
+		vector<size_t> sizes(parts.size(), 0);
+		size_t given = 0;
+		for (size_t i = 0; i + 1 < parts.size(); i++) {
+			double share = (total > 0) ? parts[i].throughput / total : 1.0 / parts.size();
+			sizes[i] = std::min((size_t)(data.size() * share), data.size() - given);
+			given += sizes[i];
+		}
+		sizes.back() = data.size() - given;
+		return sizes;
+	}
+
+	//puts each device's slice on it, replacing the previous slice
+	void partition()
+	{
+		vector<size_t> sizes = sliceSizes();
+		size_t begin = 0;
+		for (size_t i = 0; i < parts.size(); i++) {
+			DevicePart& part = parts[i];
+			if (part.id >= 0)
+				part.engine.removeDataset(part.id);
+			part.begin = begin;
+			part.count = sizes[i];
+			part.id = part.engine.addDataset(DataView(data.data() + begin, sizes[i]), part.in_place);
+			begin += sizes[i];
+		}
+	}
+
+	vector<DevicePart> parts;
+	DataView data;
+	bool has_summary;
+	RunningSummary whole_summary;
+};
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+#include "Functions.h"
+
+//SIMD the native loops are compiled with: AVX when the compiler targets it (/arch:AVX, -mavx), SSE2 on any x64 build
+#if defined(__AVX__)
+#include <immintrin.h>
+#define NATIVE_AVX
+#define NATIVE_SIMD_NAME "AVX"
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define NATIVE_SSE2
+#define NATIVE_SIMD_NAME "SSE2"
+#else
+#define NATIVE_SIMD_NAME "scalar"
+#endif
+
+//statistics on the host with std::thread and SIMD, for when there is no OpenCL device
+//or the data is small enough that an upload and kernel launches cost more than they save
+
+//fewest values worth handing to a thread of their own
+#define NATIVE_MIN_PART_ELEMENTS 65536
+
+//threads to split nr_elements values over, never more than the cores
+unsigned int nativeThreads(size_t nr_elements)
+{
+	size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+	return (unsigned int)std::max<size_t>(std::min(cores, nr_elements / NATIVE_MIN_PART_ELEMENTS), 1);
+}
+
+//runs part(t, begin, end) for nr_threads even slices of 0..nr_elements, slice 0 on the calling thread
+template <typename F>
+void nativeParallelFor(size_t nr_elements, unsigned int nr_threads, F part)
+{
+	vector<std::thread> threads;
+	for (unsigned int t = 1; t < nr_threads; t++)
+		threads.push_back(std::thread(part, t, nr_elements * t / nr_threads, nr_elements * (t + 1) / nr_threads));
+	part(0u, (size_t)0, nr_elements / nr_threads);
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+}
+
+//min/max with the sum in double, what every thread keeps for its slice
+struct NativeSummary {
+	float min;
+	float max;
+	double sum;
+	size_t count;
+
+	void merge(const NativeSummary& other)
+	{
+		min = std::min(min, other.min);
+		max = std::max(max, other.max);
+		sum += other.sum;
+		count += other.count;
+	}
+};
+
+//min, max and sum of n values, 8 (AVX) or 4 (SSE2) lanes at a time with the sums widened to double
+//NaN values are skipped by min and max (the new value is the first operand, which the instructions drop on NaN)
+NativeSummary nativeSummaryRange(const float* p, size_t n)
+{
+	NativeSummary s = { INFINITY, -INFINITY, 0, n };
+	size_t i = 0;
+#if defined(NATIVE_AVX)
+	__m256 vmin = _mm256_set1_ps(INFINITY), vmax = _mm256_set1_ps(-INFINITY);
+	__m256d vsum_lo = _mm256_setzero_pd(), vsum_hi = _mm256_setzero_pd();
+	for (; i + 8 <= n; i += 8) {
+		__m256 v = _mm256_loadu_ps(p + i);
+		vmin = _mm256_min_ps(v, vmin);
+		vmax = _mm256_max_ps(v, vmax);
+		vsum_lo = _mm256_add_pd(vsum_lo, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+		vsum_hi = _mm256_add_pd(vsum_hi, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+	}
+	float mins[8], maxs[8];
+	double sums[4];
+	_mm256_storeu_ps(mins, vmin);
+	_mm256_storeu_ps(maxs, vmax);
+	_mm256_storeu_pd(sums, _mm256_add_pd(vsum_lo, vsum_hi));
+	for (int k = 0; k < 8; k++) {
+		s.min = std::min(s.min, mins[k]);
+		s.max = std::max(s.max, maxs[k]);
+	}
+	s.sum = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+#elif defined(NATIVE_SSE2)
+	__m128 vmin = _mm_set1_ps(INFINITY), vmax = _mm_set1_ps(-INFINITY);
+	__m128d vsum_lo = _mm_setzero_pd(), vsum_hi = _mm_setzero_pd();
+	for (; i + 4 <= n; i += 4) {
+		__m128 v = _mm_loadu_ps(p + i);
+		vmin = _mm_min_ps(v, vmin);
+		vmax = _mm_max_ps(v, vmax);
+		vsum_lo = _mm_add_pd(vsum_lo, _mm_cvtps_pd(v));
+		vsum_hi = _mm_add_pd(vsum_hi, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+	}
+	float mins[4], maxs[4];
+	double sums[2];
+	_mm_storeu_ps(mins, vmin);
+	_mm_storeu_ps(maxs, vmax);
+	_mm_storeu_pd(sums, _mm_add_pd(vsum_lo, vsum_hi));
+	for (int k = 0; k < 4; k++) {
+		s.min = std::min(s.min, mins[k]);
+		s.max = std::max(s.max, maxs[k]);
+	}
+	s.sum = sums[0] + sums[1];
+#endif
+	for (; i < n; i++) {
+		s.min = std::min(s.min, p[i]);
+		s.max = std::max(s.max, p[i]);
+		s.sum += p[i];
+	}
+	return s;
+}
+
+//min, max and sum of A split over every core
+NativeSummary nativeSummaryOf(DataView A)
+{
+	unsigned int nr_threads = nativeThreads(A.size());
+	NativeSummary empty = { INFINITY, -INFINITY, 0, 0 };
+	vector<NativeSummary> parts(nr_threads, empty);
+	nativeParallelFor(A.size(), nr_threads, [&](unsigned int t, size_t begin, size_t end) {
+		parts[t] = nativeSummaryRange(A.data() + begin, end - begin);
+	});
+
+	NativeSummary total = empty;
+	for (size_t t = 0; t < parts.size(); t++)
+		total.merge(parts[t]);
+	return total;
+}
+
+//same result as parallelSummary
+Summary nativeSummary(DataView A)
+{
+	NativeSummary s = nativeSummaryOf(A);
+	Summary summary = { s.min, s.max, (cl_float)s.sum, (cl_uint)s.count };
+	return summary;
+}
+
+float nativeMin(DataView A) { return nativeSummaryOf(A).min; }
+float nativeMax(DataView A) { return nativeSummaryOf(A).max; }
+
+//mean with the sum kept in double, as accurate as normalMean
+double nativeMean(DataView A) { return nativeSummaryOf(A).sum / A.size(); }
+
+//count, mean and central moments of A, a second pass over the data once the mean is known
+//two passes in double are cheap on the host and more accurate than the one pass Welford merge the device needs
+Moments nativeMoments(DataView A)
+{
+	double mean = nativeMean(A);
+	unsigned int nr_threads = nativeThreads(A.size());
+	vector<double> m2(nr_threads, 0), m3(nr_threads, 0), m4(nr_threads, 0);
+	nativeParallelFor(A.size(), nr_threads, [&](unsigned int t, size_t begin, size_t end) {
+		double s2 = 0, s3 = 0, s4 = 0;
+		for (size_t i = begin; i < end; i++) {
+			double d = A[i] - mean, d2 = d * d;
+			s2 += d2;
+			s3 += d2 * d;
+			s4 += d2 * d2;
+		}
+		m2[t] = s2; m3[t] = s3; m4[t] = s4;
+	});
+
+	Moments moments = { (cl_uint)A.size(), (cl_float)mean, 0, 0, 0 };
+	double s2 = 0, s3 = 0, s4 = 0;
+	for (unsigned int t = 0; t < nr_threads; t++) {
+		s2 += m2[t]; s3 += m3[t]; s4 += m4[t];
+	}
+	moments.m2 = (cl_float)s2;
+	moments.m3 = (cl_float)s3;
+	moments.m4 = (cl_float)s4;
+	return moments;
+}
+
+//values at fractions ps of the sorted data, interpolated like percentilesOnDevice
+//each rank is placed with nth_element on a copy, working up from the smallest so every step only looks at what is left
+vector<double> nativePercentiles(DataView A, const vector<double>& ps)
+{
+	if (A.empty())
+		throw cl::Error(CL_INVALID_VALUE, "Percentiles of an empty dataset");
+
+	std::set<size_t> ranks;
+	for (size_t i = 0; i < ps.size(); i++) {
+		if (!(ps[i] >= 0) || (ps[i] > 1))
+			throw cl::Error(CL_INVALID_VALUE, "Percentiles must be between 0 and 1");
+		double pos = ps[i] * (A.size() - 1);
+		ranks.insert((size_t)floor(pos));
+		ranks.insert((size_t)ceil(pos));
+	}
+
+	//ordered by floatKey like the device select, so NaN sorts last instead of breaking the comparison
+	vector<mytype> copy(A.begin(), A.end());
+	std::map<size_t, mytype> selected;
+	size_t done = 0;
+	for (std::set<size_t>::iterator r = ranks.begin(); r != ranks.end(); ++r) {
+		std::nth_element(copy.begin() + done, copy.begin() + *r, copy.end(),
+			[](float a, float b) { return floatKey(a) < floatKey(b); });
+		selected[*r] = copy[*r];
+		done = *r;
+	}
+
+	vector<double> result;
+	for (size_t i = 0; i < ps.size(); i++) {
+		double pos = ps[i] * (A.size() - 1);
+		size_t lo = (size_t)floor(pos), hi = (size_t)ceil(pos);
+		result.push_back(selected[lo] + (pos - lo) * ((double)selected[hi] - selected[lo]));
+	}
+	return result;
+}
+
+//min/max/sum/count for every key 1..nr_keys (one key per value, anything else is skipped), like summaryByKeyOnDevice
+vector<Summary> nativeSummaryByKey(DataView A, const cl_uchar* keys, int nr_keys)
+{
+	unsigned int nr_threads = nativeThreads(A.size());
+	NativeSummary empty = { INFINITY, -INFINITY, 0, 0 };
+	vector<vector<NativeSummary> > parts(nr_threads, vector<NativeSummary>(std::max(nr_keys, 0), empty));
+	nativeParallelFor(A.size(), nr_threads, [&](unsigned int t, size_t begin, size_t end) {
+		vector<NativeSummary>& part = parts[t];
+		for (size_t i = begin; i < end; i++) {
+			unsigned int k = keys[i] - 1u;
+			if (k < (unsigned int)nr_keys) {
+				NativeSummary& s = part[k];
+				s.min = std::min(s.min, A[i]);
+				s.max = std::max(s.max, A[i]);
+				s.sum += A[i];
+				s.count++;
+			}
+		}
+	});
+
+	vector<Summary> result;
+	for (int k = 0; k < nr_keys; k++) {
+		NativeSummary total = empty;
+		for (unsigned int t = 0; t < nr_threads; t++)
+			total.merge(parts[t][k]);
+		Summary summary = { total.min, total.max, (cl_float)total.sum, (cl_uint)total.count };
+		result.push_back(summary);
+	}
+	return result;
+}
+
+//histogram of A with one private histogram per thread, added together at the end so no counter is shared
+Histogram nativeHistogram(DataView A, const BinLayout& layout)
+{
+	unsigned int nr_threads = nativeThreads(A.size());
+	size_t nr_counters = histogramCounters(layout);
+	vector<vector<int> > parts(nr_threads, vector<int>(nr_counters, 0));
+	nativeParallelFor(A.size(), nr_threads, [&](unsigned int t, size_t begin, size_t end) {
+		vector<int>& H = parts[t];
+		for (size_t i = begin; i < end; i++)
+			H[normalBin(A[i], layout)]++;
+	});
+
+	vector<int> H(nr_counters, 0);
+	for (unsigned int t = 0; t < nr_threads; t++)
+		for (size_t c = 0; c < nr_counters; c++)
+			H[c] += parts[t][c];
+	return makeHistogram(H, layout);
+}
+
+//histogram with nr_bins equal width bins between the rounded min and max, the same bins StatsEngine::histogram uses
+Histogram nativeHistogram(DataView A, int nr_bins)
+{
+	NativeSummary s = nativeSummaryOf(A);
+	return nativeHistogram(A, uniformBins(floor(s.min), ceil(s.max) + 1, nr_bins));
+}
+
+//what the native path runs with, for the log
+string nativeDescription()
+{
+	return std::to_string(std::max(std::thread::hardware_concurrency(), 1u)) + " threads, " + NATIVE_SIMD_NAME;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+#include "Utils.h"
+
+using namespace std;
+
+//one command captured while profiling, bytes and elements are what it moved or processed
+struct ProfileRecord {
+	string stage;
+	cl::Event event;
+	size_t bytes;
+	size_t elements;
+};
+
+//times of every command of one stage (a kernel name, or write/read/fill), added together
+struct StageProfile {
+	string stage;
+	size_t count;
+	double queued_ms; //queued -> submitted
+	double submit_ms; //submitted -> started
+	double exec_ms; //started -> ended
+	size_t bytes;
+	size_t elements;
+
+	double gbPerSecond() const { return exec_ms ? bytes / (exec_ms * 1e6) : 0; }
+	double elementsPerSecond() const { return exec_ms ? elements / (exec_ms / 1e3) : 0; }
+};
+
+//collects events from the enqueue calls of the reduction, histogram and transfer paths
+//the queue has to be created with CL_QUEUE_PROFILING_ENABLE for the times to be available
+class Profiler {
+public:
+	Profiler() : peak_gb_per_second(0) {}
+
+	//event to hand to an enqueue call, it stays valid until clear()
+	cl::Event* record(const string& stage, size_t bytes, size_t elements)
+	{
+		ProfileRecord record = { stage, cl::Event(), bytes, elements };
+		records.push_back(record);
+		return &records.back().event;
+	}
+
+	//device memory bandwidth to compare against, 0 leaves the comparison out (OpenCL cannot report it)
+	void setPeakBandwidth(double gb_per_second) { peak_gb_per_second = gb_per_second; }
+
+	//per stage totals in the order the stages first ran, waits for any command still running
+	vector<StageProfile> stages()
+	{
+		vector<StageProfile> result;
+		std::map<string, size_t> index;
+		for (size_t i = 0; i < records.size(); i++) {
+			ProfileRecord& record = records[i];
+			record.event.wait();
+			cl_ulong queued = record.event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>();
+			cl_ulong submit = record.event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>();
+			cl_ulong start = record.event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+			cl_ulong end = record.event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+
+			if (!index.count(record.stage)) {
+				index[record.stage] = result.size();
+				StageProfile stage = { record.stage, 0, 0, 0, 0, 0, 0 };
+				result.push_back(stage);
+			}
+			StageProfile& stage = result[index[record.stage]];
+			stage.count++;
+			stage.queued_ms += (submit - queued) / (double)PROF_MS;
+			stage.submit_ms += (start - submit) / (double)PROF_MS;
+			stage.exec_ms += (end - start) / (double)PROF_MS;
+			stage.bytes += record.bytes;
+			stage.elements += record.elements;
+		}
+		return result;
+	}
+
+	//table for the console
+	void print(std::ostream& out)
+	{
+		vector<StageProfile> all = stages();
+		out << "--------------------------------------------------------------------------------------------" << std::endl;
+		out << "Profile, times added over every call" << std::endl;
+		out << "--------------------------------------------------------------------------------------------" << std::endl;
+		out << std::left << std::setw(32) << "stage" << std::setw(7) << "calls" << std::setw(12) << "queued[ms]" << std::setw(12) << "submit[ms]"
+			<< std::setw(12) << "exec[ms]" << std::setw(10) << "GB/s" << std::setw(12) << "Melem/s";
+		if (peak_gb_per_second)
+			out << "of peak";
+		out << std::endl;
+		for (size_t i = 0; i < all.size(); i++) {
+			const StageProfile& s = all[i];
+			out << std::setw(32) << s.stage << std::setw(7) << s.count << std::setw(12) << s.queued_ms << std::setw(12) << s.submit_ms
+				<< std::setw(12) << s.exec_ms << std::setw(10) << s.gbPerSecond() << std::setw(12) << s.elementsPerSecond() / 1e6;
+			if (peak_gb_per_second)
+				out << 100 * s.gbPerSecond() / peak_gb_per_second << "%";
+			out << std::endl;
+		}
+		out << "--------------------------------------------------------------------------------------------" << std::endl;
+		out << std::right;
+	}
+
+	//one object per stage, for tracking runs across builds
+	string json()
+	{
+		vector<StageProfile> all = stages();
+		stringstream out;
+		out << "{\"peak_gb_per_second\": " << peak_gb_per_second << ", \"stages\": [";
+		for (size_t i = 0; i < all.size(); i++) {
+			const StageProfile& s = all[i];
+			out << (i ? ", " : "") << "{\"stage\": \"" << s.stage << "\", \"calls\": " << s.count
+				<< ", \"queued_ms\": " << s.queued_ms << ", \"submit_ms\": " << s.submit_ms << ", \"exec_ms\": " << s.exec_ms
+				<< ", \"bytes\": " << s.bytes << ", \"elements\": " << s.elements
+				<< ", \"gb_per_second\": " << s.gbPerSecond() << ", \"elements_per_second\": " << s.elementsPerSecond() << "}";
+		}
+		out << "]}" << std::endl;
+		return out.str();
+	}
+
+	//same as json with one line per stage
+	string csv()
+	{
+		vector<StageProfile> all = stages();
+		stringstream out;
+		out << "stage,calls,queued_ms,submit_ms,exec_ms,bytes,elements,gb_per_second,elements_per_second" << std::endl;
+		for (size_t i = 0; i < all.size(); i++) {
+			const StageProfile& s = all[i];
+			out << s.stage << "," << s.count << "," << s.queued_ms << "," << s.submit_ms << "," << s.exec_ms << ","
+				<< s.bytes << "," << s.elements << "," << s.gbPerSecond() << "," << s.elementsPerSecond() << std::endl;
+		}
+		return out.str();
+	}
+
+	void clear() { records.clear(); }
+
+private:
+	std::deque<ProfileRecord> records; //deque so the events handed out do not move
+	double peak_gb_per_second;
+};
+
+//profiler the enqueue calls report to, NULL when profiling is off
+Profiler* active_profiler = NULL;
+
+//event for an enqueue call when profiling, otherwise NULL so the call records nothing
+inline cl::Event* profileEvent(const string& stage, size_t bytes, size_t elements = 0)
+{
+	return active_profiler ? active_profiler->record(stage, bytes, elements) : NULL;
+}
+
+//as profileEvent, named after the kernel
+inline cl::Event* profileKernel(const cl::Kernel& kernel, size_t bytes, size_t elements)
+{
+	if (!active_profiler)
+		return NULL;
+	string name = kernel.getInfo<CL_KERNEL_FUNCTION_NAME>().c_str(); //drop the terminating null some drivers include
+	return active_profiler->record(name, bytes, elements);
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "Utils.h"
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+//compiled program binaries kept on disk, so later runs load them with clCreateProgramWithBinary instead of running the compiler
+//layout: header | binary, one file per program named by its key, a key that changed simply misses and the program is rebuilt
+//the key covers the source, build options, device name and driver version, so editing a kernel or updating the driver never loads a stale binary
+
+#define PROGRAM_CACHE_MAGIC "CLPROG"
+#define PROGRAM_CACHE_VERSION 1
+
+//folder the binaries are written to, relative to the working directory like my_kernels.cl, empty turns the cache off
+string program_cache_dir = "kernel_cache";
+
+struct ProgramCacheHeader {
+	char magic[8];
+	cl_uint version;
+	cl_uint padding;
+	cl_ulong key; //programCacheKey the binary was built for
+	cl_ulong binary_size;
+};
+
+//64 bit FNV-1a hash of text, continued from hash so several strings can be chained
+cl_ulong hashText(const string& text, cl_ulong hash = 14695981039346656037ull)
+{
+	for (size_t i = 0; i < text.size(); i++) {
+		hash ^= (unsigned char)text[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+//everything a compiled binary depends on, a 0 byte after each part so moving text from one part to the next changes the key
+cl_ulong programCacheKey(const string& source, const string& options, const cl::Device& device)
+{
+	const string parts[] = { source, options, device.getInfo<CL_DEVICE_NAME>().c_str(), device.getInfo<CL_DRIVER_VERSION>().c_str(),
+		device.getInfo<CL_DEVICE_VERSION>().c_str() };
+	cl_ulong hash = hashText("");
+	for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+		hash = hashText(string(1, '\0'), hashText(parts[i], hash));
+	return hash;
+}
+
+//the cache file of a key, e.g. kernel_cache/3f2a9c0d1e4b5a6c.bin
+string programCacheFile(const string& cache_dir, cl_ulong key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return cache_dir + "/" + name;
+}
+
+//creates the cache folder if it is not there yet, false if it cannot be made
+bool makeCacheDir(const string& cache_dir)
+{
+	struct stat st;
+	if (stat(cache_dir.c_str(), &st) == 0)
+		return (st.st_mode & S_IFDIR) != 0;
+#ifdef _WIN32
+	return _mkdir(cache_dir.c_str()) == 0;
+#else
+	return mkdir(cache_dir.c_str(), 0755) == 0;
+#endif
+}
+
+//the binary stored for key, empty if there is none or the file is damaged
+vector<unsigned char> readProgramBinary(const string& cache_dir, cl_ulong key)
+{
+	vector<unsigned char> binary;
+	ifstream file(programCacheFile(cache_dir, key), ios::binary);
+	if (!file)
+		return binary;
+
+	ProgramCacheHeader header;
+	file.read((char*)&header, sizeof(header));
+	if (file.fail() || memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) || (header.version != PROGRAM_CACHE_VERSION)
+		|| (header.key != key) || !header.binary_size)
+		return binary;
+
+	binary.resize((size_t)header.binary_size);
+	file.read((char*)&binary[0], binary.size());
+	if (file.gcount() != (std::streamsize)binary.size())
+		binary.clear(); //cut short, e.g. the disk filled up while it was written
+	return binary;
+}
+
+//stores the binary the device compiled program into, written to a temporary file first like the data cache
+//returns false if it could not be written, the program still works in that case and is just built again next time
+bool writeProgramBinary(const string& cache_dir, cl_ulong key, const cl::Program& program)
+{
+	//one device per program, so one binary, read with the C API as the bindings leave the buffers for the caller to allocate
+	size_t binary_size = 0;
+	if ((clGetProgramInfo(program(), CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, NULL) != CL_SUCCESS) || !binary_size)
+		return false;
+	vector<unsigned char> binary(binary_size);
+	unsigned char* binary_ptr = &binary[0];
+	if (clGetProgramInfo(program(), CL_PROGRAM_BINARIES, sizeof(unsigned char*), &binary_ptr, NULL) != CL_SUCCESS)
+		return false;
+
+	if (!makeCacheDir(cache_dir))
+		return false;
+
+	ProgramCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+	header.version = PROGRAM_CACHE_VERSION;
+	header.key = key;
+	header.binary_size = binary_size;
+
+	string cache_file = programCacheFile(cache_dir, key);
+	string temp_file = cache_file + ".tmp";
+	{
+		ofstream file(temp_file, ios::binary | ios::trunc);
+		if (file.fail())
+			return false;
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)&binary[0], binary.size());
+		if (file.fail()) {
+			file.close();
+			remove(temp_file.c_str());
+			return false;
+		}
+	}
+
+	remove(cache_file.c_str()); //rename does not replace an existing file on Windows
+	return rename(temp_file.c_str(), cache_file.c_str()) == 0;
+}
+
+//builds source for device, from the cached binary when there is one for the same key and by compiling it otherwise
+//a binary the driver rejects is treated like a miss, then the fresh build replaces it
+//from_cache, when given, is set to whether the compiler was skipped
+cl::Program buildProgram(const cl::Context& context, const cl::Device& device, const string& source, const string& options = "",
+	bool* from_cache = NULL)
+{
+	vector<cl::Device> devices(1, device);
+	cl_ulong key = 0;
+	if (from_cache)
+		*from_cache = false;
+
+	if (!program_cache_dir.empty()) {
+		key = programCacheKey(source, options, device);
+		vector<unsigned char> binary = readProgramBinary(program_cache_dir, key);
+		if (!binary.empty()) {
+			try {
+				cl::Program::Binaries binaries(1, make_pair((const void*)&binary[0], binary.size()));
+				cl::Program program(context, devices, binaries);
+				program.build(devices, options.c_str());
+				if (from_cache)
+					*from_cache = true;
+				return program;
+			}
+			catch (const cl::Error&) {
+				//the driver cannot use it after all, e.g. an update that kept its version string, so build from source
+			}
+		}
+	}
+
+	cl::Program::Sources sources;
+	sources.push_back(make_pair(source.c_str(), source.length() + 1));
+	cl::Program program(context, sources);
+
+	//build and debug the kernel code
+	try {
+		program.build(devices, options.c_str());
+	}
+	catch (const cl::Error& err) {
+		std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device) << std::endl;
+		std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(device) << std::endl;
+		std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+		throw err;
+	}
+
+	if (!program_cache_dir.empty())
+		writeProgramBinary(program_cache_dir, key, program);
+	return program;
+}
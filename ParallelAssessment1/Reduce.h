@@ -0,0 +1,257 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+#include "Functions.h"
+#include "ProgramCache.h"
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+//reductions of any element type with any operator, from one kernel source (reduce_generic.cl) specialised with -D build options
+//the element type picks the types the kernels are built with and the operator picks the identity and combine,
+//so a new statistic only needs an operator and quantised integer or half data needs only a type
+
+//a half precision value as stored on the device, cl_half on its own is just a cl_ushort
+struct Half {
+	cl_half bits;
+};
+
+//float to half, rounded to nearest even, too large values become infinity
+Half floatToHalf(float value)
+{
+	cl_uint x;
+	memcpy(&x, &value, sizeof(x));
+	cl_uint sign = (x >> 16) & 0x8000;
+	cl_uint mant = x & 0x7fffff;
+	int exp = (int)((x >> 23) & 0xff);
+
+	Half h;
+	if (exp == 0xff) { //infinity and NaN
+		h.bits = (cl_half)(sign | 0x7c00 | (mant ? 0x200 : 0));
+		return h;
+	}
+
+	int e = exp - 127 + 15;
+	cl_uint bits, rest, halfway;
+	if (e >= 31) {
+		h.bits = (cl_half)(sign | 0x7c00);
+		return h;
+	}
+	if (e <= 0) { //subnormal half, or too small and rounds to zero
+		if (e < -10) {
+			h.bits = (cl_half)sign;
+			return h;
+		}
+		mant |= 0x800000;
+		int shift = 14 - e;
+		bits = mant >> shift;
+		rest = mant & ((1u << shift) - 1);
+		halfway = 1u << (shift - 1);
+	}
+	else {
+		bits = ((cl_uint)e << 10) | (mant >> 13);
+		rest = mant & 0x1fff;
+		halfway = 0x1000;
+	}
+	if ((rest > halfway) || ((rest == halfway) && (bits & 1)))
+		bits++; //a carry out of the mantissa moves into the exponent, which is the right answer
+	h.bits = (cl_half)(sign | bits);
+	return h;
+}
+
+float halfToFloat(Half h)
+{
+	cl_uint sign = (cl_uint)(h.bits & 0x8000) << 16;
+	cl_uint exp = (h.bits >> 10) & 0x1f;
+	cl_uint mant = h.bits & 0x3ff;
+
+	float value;
+	if (exp == 0) //zero and subnormals, mant * 2^-24
+		value = ldexp((float)mant, -24);
+	else if (exp == 31)
+		value = mant ? NAN : INFINITY;
+	else
+		value = ldexp((float)(mant | 0x400), (int)exp - 25);
+	return sign ? -value : value;
+}
+
+//element types the generic kernels can be built for, Acc is what the values are combined in on the device and returned as
+template <typename T> struct ReduceType;
+
+template <> struct ReduceType<cl_float> {
+	typedef cl_float Acc;
+	static const char* name() { return "float"; }
+	static const char* options() { return "-D T=float -D ACC=float -D ACC_MAX=INFINITY -D ACC_LOWEST=-INFINITY -D MINFN=fmin -D MAXFN=fmax"; }
+	static bool needsDouble() { return false; }
+};
+
+template <> struct ReduceType<cl_double> {
+	typedef cl_double Acc;
+	static const char* name() { return "double"; }
+	static const char* options() { return "-D T=double -D ACC=double -D ACC_MAX=INFINITY -D ACC_LOWEST=-INFINITY -D MINFN=fmin -D MAXFN=fmax -D USE_DOUBLE"; }
+	static bool needsDouble() { return true; }
+};
+
+//combined in 64 bit so sums of many quantised readings (e.g. tenths of a degree) cannot overflow
+template <> struct ReduceType<cl_int> {
+	typedef cl_long Acc;
+	static const char* name() { return "int"; }
+	static const char* options() { return "-D T=int -D ACC=long -D ACC_MAX=LONG_MAX -D ACC_LOWEST=LONG_MIN -D MINFN=min -D MAXFN=max"; }
+	static bool needsDouble() { return false; }
+};
+
+//half the memory traffic of float, loaded with vload_half and combined in float
+template <> struct ReduceType<Half> {
+	typedef cl_float Acc;
+	static const char* name() { return "half"; }
+	static const char* options() { return "-D T=half -D ACC=float -D ACC_MAX=INFINITY -D ACC_LOWEST=-INFINITY -D MINFN=fmin -D MAXFN=fmax -D LOAD_HALF"; }
+	static bool needsDouble() { return false; }
+};
+
+//operators, each gives its identity and combine both as kernel source and on the host
+//the kernel source may use ACC, ACC_MAX and ACC_LOWEST, and must not contain spaces as it is passed as a build option
+struct SumOp {
+	static const char* name() { return "sum"; }
+	static const char* identitySource() { return "((ACC)0)"; }
+	static const char* combineSource() { return "((a)+(b))"; }
+	template <typename A> static A identity() { return A(0); }
+	template <typename A> static A combine(A a, A b) { return a + b; }
+};
+
+//min and max skip NaN on the device, floating types build with fmin/fmax (which return the other operand, min/max are undefined for NaN)
+//and int with min/max, the host versions skip NaN the same way
+struct MinOp {
+	static const char* name() { return "min"; }
+	static const char* identitySource() { return "((ACC)ACC_MAX)"; }
+	static const char* combineSource() { return "MINFN(a,b)"; }
+	template <typename A> static A identity() { return std::numeric_limits<A>::has_infinity ? std::numeric_limits<A>::infinity() : std::numeric_limits<A>::max(); }
+	template <typename A> static A combine(A a, A b) { return (b < a) || (a != a) ? b : a; }
+};
+
+struct MaxOp {
+	static const char* name() { return "max"; }
+	static const char* identitySource() { return "((ACC)ACC_LOWEST)"; }
+	static const char* combineSource() { return "MAXFN(a,b)"; }
+	template <typename A> static A identity() { return std::numeric_limits<A>::has_infinity ? -std::numeric_limits<A>::infinity() : std::numeric_limits<A>::lowest(); }
+	template <typename A> static A combine(A a, A b) { return (b > a) || (a != a) ? b : a; }
+};
+
+//value a type is combined as on the host, only half needs converting
+template <typename T> typename ReduceType<T>::Acc reduceLoad(const T& value) { return (typename ReduceType<T>::Acc)value; }
+template <> cl_float reduceLoad<Half>(const Half& value) { return halfToFloat(value); }
+
+//the same reduction done sequentially on the host, to check the device against
+template <typename T, typename Op>
+typename ReduceType<T>::Acc normalReduce(const T* values, size_t nr_elements)
+{
+	typedef typename ReduceType<T>::Acc Acc;
+	Acc acc = Op::template identity<Acc>();
+	for (size_t i = 0; i < nr_elements; i++)
+		acc = Op::combine(acc, reduceLoad(values[i]));
+	return acc;
+}
+
+//build options that specialise reduce_generic.cl for type T and operator Op
+template <typename T, typename Op>
+string reduceBuildOptions()
+{
+	return string(ReduceType<T>::options()) + " -D IDENTITY=" + Op::identitySource() + " -D COMBINE(a,b)=" + Op::combineSource();
+}
+
+//the two kernels of one specialisation, values reads T and partials merges Acc
+struct ReduceKernels {
+	cl::Program program;
+	cl::Kernel values;
+	cl::Kernel partials;
+	size_t local_size; //largest power of two both kernels can run with
+};
+
+//builds a specialisation of the generic kernels the first time a (type, op) pair is asked for, then keeps it
+class ReduceKernelCache {
+public:
+	//remembers the device and where the kernel source is, nothing is read or built yet
+	void init(const cl::Context& device_context, const string& kernel_file = "reduce_generic.cl")
+	{
+		context = device_context;
+		device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+		source_file = kernel_file;
+		source.clear();
+		kernels.clear();
+	}
+
+	template <typename T, typename Op>
+	ReduceKernels& get()
+	{
+		string key = string(ReduceType<T>::name()) + " " + Op::name();
+		std::map<string, ReduceKernels>::iterator found = kernels.find(key);
+		if (found != kernels.end())
+			return found->second;
+
+		if (ReduceType<T>::needsDouble() && !supportsDouble(device))
+			throw cl::Error(CL_INVALID_DEVICE, "Reducing doubles needs a device with cl_khr_fp64");
+
+		if (source.empty())
+			source = LoadSource(source_file);
+
+		ReduceKernels built;
+		built.program = buildProgram(context, device, source, reduceBuildOptions<T, Op>());
+
+		built.values = cl::Kernel(built.program, "reduce_values");
+		built.partials = cl::Kernel(built.program, "reduce_partials");
+		built.local_size = powerOfTwoFloor(std::min(built.values.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device),
+			built.partials.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device)));
+
+		return kernels[key] = built;
+	}
+
+	//how many specialisations have been built so far
+	size_t size() const { return kernels.size(); }
+
+private:
+	cl::Context context;
+	cl::Device device;
+	string source_file;
+	string source;
+	std::map<string, ReduceKernels> kernels; //keyed by "type op"
+};
+
+//reduces nr_elements values of type T in buffer_A with operator Op, the identity for no values
+//buffer_B and buffer_C need room for groupCount(nr_elements, local_size) values of Acc,
+//local_size must not be above kernels.local_size
+template <typename T, typename Op>
+typename ReduceType<T>::Acc reduce(cl::CommandQueue& queue, ReduceKernels& kernels, size_t local_size, const cl::Buffer& buffer_A, size_t nr_elements,
+	const cl::Buffer& buffer_B, const cl::Buffer& buffer_C, size_t items_per_work_item = 1)
+{
+	typedef typename ReduceType<T>::Acc Acc;
+	if (!nr_elements)
+		return Op::template identity<Acc>();
+	return reducePartialsOnDevice<Acc>(queue, kernels.values, kernels.partials, local_size, buffer_A, nr_elements, buffer_B, buffer_C,
+		items_per_work_item, sizeof(T));
+}
+
+//one-off reduction of host values, uploads them and allocates the partial buffers for this call only
+template <typename T, typename Op>
+typename ReduceType<T>::Acc parallelReduce(cl::Context& context, cl::CommandQueue& queue, ReduceKernelCache& cache, const vector<T>& A)
+{
+	typedef typename ReduceType<T>::Acc Acc;
+	ReduceKernels& kernels = cache.get<T, Op>();
+	size_t nr_groups = std::max(groupCount(A.size(), kernels.local_size), (size_t)1);
+
+	cl::Buffer buffer_A(context, CL_MEM_READ_ONLY, std::max(A.size(), (size_t)1) * sizeof(T));
+	if (!A.empty())
+		queue.enqueueWriteBuffer(buffer_A, CL_TRUE, 0, A.size() * sizeof(T), &A[0], NULL, profileEvent("write", A.size() * sizeof(T)));
+	cl::Buffer buffer_B(context, CL_MEM_READ_WRITE, nr_groups * sizeof(Acc));
+	cl::Buffer buffer_C(context, CL_MEM_READ_WRITE, nr_groups * sizeof(Acc));
+
+	return reduce<T, Op>(queue, kernels, kernels.local_size, buffer_A, A.size(), buffer_B, buffer_C);
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "Functions.h"
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+//mergeable approximate quantile sketch in the style of KLL
+//level h holds values that each stand for 2^h input values, a level that grows past k values is sorted and every other value
+//(from a random start) moves up a level, so memory stays at O(k log N) values
+//every compaction moves a rank by up to its weight either way with a mean of zero, so ranks are off by about N / k on average
+//while the worst case, with every compaction erring the same way, is about N / k * log2(N / k)
+class QuantileSketch {
+public:
+	//k values per level, the expected rank error is roughly 1 / k of the count
+	QuantileSketch(int k = 1024) : k(std::max(k, 2)), count(0), random(12345) {}
+
+	//capacity per level giving an expected rank error of about epsilon / 2 (as a fraction of the count), so typically within epsilon
+	//it is not a bound, the worst case is log2(N * epsilon / 2) times that
+	static int capacityFor(double epsilon) { return (int)std::min(ceil(2.0 / std::max(epsilon, 1e-6)), 1048576.0); }
+
+	int capacity() const { return k; }
+	double size() const { return count; }
+
+	//values that each stand for 2^level input values, NAN values are skipped
+	void add(const float* values, size_t nr_values, int level = 0)
+	{
+		if ((int)levels.size() <= level)
+			levels.resize(level + 1);
+		for (size_t i = 0; i < nr_values; i++) {
+			if (values[i] != values[i])
+				continue;
+			levels[level].push_back(values[i]);
+			count += ldexp(1.0, level);
+		}
+		compact(level);
+	}
+
+	void add(float value) { add(&value, 1); }
+
+	//fold another sketch in, the result is as if every value had been added to this one
+	void merge(const QuantileSketch& other)
+	{
+		for (size_t h = 0; h < other.levels.size(); h++)
+			if (!other.levels[h].empty())
+				add(&other.levels[h][0], other.levels[h].size(), (int)h);
+	}
+
+	//approximate value at fraction p (0 to 1) of the sorted input
+	double quantile(double p) const
+	{
+		vector<std::pair<float, double> > weighted; //value and how many input values it stands for
+		for (size_t h = 0; h < levels.size(); h++)
+			for (size_t i = 0; i < levels[h].size(); i++)
+				weighted.push_back(std::make_pair(levels[h][i], ldexp(1.0, (int)h)));
+		if (weighted.empty())
+			return NAN;
+		std::sort(weighted.begin(), weighted.end());
+
+		double target = p * count, seen = 0;
+		for (size_t i = 0; i < weighted.size(); i++) {
+			seen += weighted[i].second;
+			if (seen >= target)
+				return weighted[i].first;
+		}
+		return weighted.back().first;
+	}
+
+	vector<double> quantiles(const vector<double>& ps) const
+	{
+		vector<double> result;
+		for (size_t i = 0; i < ps.size(); i++)
+			result.push_back(quantile(ps[i]));
+		return result;
+	}
+
+	//values held, for checking the memory bound
+	size_t stored() const
+	{
+		size_t n = 0;
+		for (size_t h = 0; h < levels.size(); h++)
+			n += levels[h].size();
+		return n;
+	}
+
+private:
+	//push overfull levels up, starting at level
+	void compact(int level)
+	{
+		for (size_t h = level; h < levels.size(); h++) {
+			if ((int)levels[h].size() <= k)
+				continue;
+
+			vector<float>& values = levels[h];
+			std::sort(values.begin(), values.end());
+
+			//an odd value out stays behind so the pairs split evenly
+			float left_over = 0;
+			bool has_left_over = (values.size() % 2) != 0;
+			if (has_left_over) {
+				left_over = values.back();
+				values.pop_back();
+			}
+
+			if (h + 1 == levels.size())
+				levels.resize(h + 2); //may move the levels, so values is not used past here
+			vector<float>& current = levels[h];
+			vector<float>& next = levels[h + 1];
+			size_t start = random() & 1;
+			for (size_t i = start; i < current.size(); i += 2)
+				next.push_back(current[i]);
+
+			//half of the values go up at twice the weight, so the count does not change
+			current.clear();
+			if (has_left_over)
+				current.push_back(left_over);
+		}
+	}
+
+	int k;
+	double count;
+	vector<vector<float> > levels;
+	std::minstd_rand random;
+};
+
+//values per block the sketch kernel sorts in local memory, a power of two that fits twice over in local memory
+size_t sketchBlockSize(cl_ulong local_mem_size, size_t max_block = 4096)
+{
+	size_t block = powerOfTwoFloor(std::min((size_t)(local_mem_size / 2 / sizeof(mytype)), max_block));
+	return std::max(block, (size_t)2);
+}
+
+//enqueues the first sketch level without waiting: every group sorts one block of buffer_A and keeps a sample of it in buffer_S
+//buffer_S needs room for groupCount(input_elements, block) * samples values, samples is a power of two no bigger than block
+void enqueueSketch(cl::CommandQueue& queue, cl::Kernel& kernel, size_t local_size, const cl::Buffer& buffer_A, size_t input_elements,
+	size_t block, size_t samples, const cl::Buffer& buffer_S, cl_uint seed = 1, const vector<cl::Event>* wait_events = NULL)
+{
+	kernel.setArg(0, buffer_A);
+	kernel.setArg(1, buffer_S);
+	kernel.setArg(2, cl::Local(block * sizeof(mytype)));
+	kernel.setArg(3, (cl_int)input_elements);
+	kernel.setArg(4, (cl_int)block);
+	kernel.setArg(5, (cl_int)samples);
+	kernel.setArg(6, seed);
+	queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(groupCount(input_elements, block) * local_size), cl::NDRange(local_size), wait_events,
+		profileKernel(kernel, input_elements * sizeof(mytype), input_elements));
+}
+
+//sketch level the samples of enqueueSketch enter at, each one stands for block / samples values
+int sketchLevel(size_t block, size_t samples)
+{
+	int level = 0;
+	while (((size_t)1 << level) < block / samples)
+		level++;
+	return level;
+}
+
+//builds the first sketch level on the device and adds the samples to sketch
+void sketchOnDevice(cl::CommandQueue& queue, cl::Kernel& kernel, size_t local_size, const cl::Buffer& buffer_A, size_t input_elements,
+	size_t block, size_t samples, const cl::Buffer& buffer_S, QuantileSketch& sketch, cl_uint seed = 1)
+{
+	if (!input_elements)
+		return;
+
+	enqueueSketch(queue, kernel, local_size, buffer_A, input_elements, block, samples, buffer_S, seed);
+
+	vector<float> S(groupCount(input_elements, block) * samples);
+	queue.enqueueReadBuffer(buffer_S, CL_TRUE, 0, S.size() * sizeof(float), &S[0], NULL, profileEvent("read samples", S.size() * sizeof(float)));
+	sketch.add(&S[0], S.size(), sketchLevel(block, samples));
+}
+
+//samples kept per block: enough for the sketch's own accuracy but never more than the block
+size_t sketchSamples(const QuantileSketch& sketch, size_t block)
+{
+	return std::min(powerOfTwoCeil(sketch.capacity()) / 2, block);
+}
+
+//function to find approximate quantiles of A with an expected rank error within epsilon (see capacityFor), with O(k log N) memory
+vector<double> parallelApproxPercentiles(cl::Context& context, cl::Program & program, cl::CommandQueue& queue, DataView A,
+	const vector<double>& ps, double epsilon = 0.001)
+{
+	cl::Kernel kernel_1 = cl::Kernel(program, "sketch_block");
+
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+	size_t local_size = kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+
+	QuantileSketch sketch(QuantileSketch::capacityFor(epsilon));
+	size_t block = sketchBlockSize(device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>());
+	size_t samples = sketchSamples(sketch, block);
+
+	cl::Buffer buffer_A = inputBuffer(context, device, A);
+	cl::Buffer buffer_S(context, CL_MEM_WRITE_ONLY, std::max(groupCount(A.size(), block), (size_t)1) * samples * sizeof(float));
+
+	sketchOnDevice(queue, kernel_1, local_size, buffer_A, A.size(), block, samples, buffer_S, sketch);
+	return sketch.quantiles(ps);
+}
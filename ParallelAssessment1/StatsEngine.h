@@ -0,0 +1,494 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+#include "Utils.h"
+#include "Functions.h"
+#include "Reduce.h"
+#include "ProgramCache.h"
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+//keeps the OpenCL context, program, kernels and uploaded datasets alive between queries
+//so repeated summaries and histograms do not re-upload data or re-create kernels
+class StatsEngine {
+public:
+	//select the device, build the kernels and create all kernel objects once
+	//profiling creates the queue with CL_QUEUE_PROFILING_ENABLE so a Profiler can read the command times
+	void init(int platform_id, int device_id, const string& kernel_file = "my_kernels.cl", bool profiling = false)
+	{
+		init(GetContext(platform_id, device_id), kernel_file, profiling);
+	}
+
+	//same with a context made elsewhere, e.g. for one of several devices or a sub-device, only its first device is used
+	void init(const cl::Context& device_context, const string& kernel_file = "my_kernels.cl", bool profiling = false)
+	{
+		context = device_context;
+		device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+
+		//create a queue to which we will push commands for the device
+		queue = cl::CommandQueue(context, device, profiling ? CL_QUEUE_PROFILING_ENABLE : 0);
+
+		//Load & build the device code, from the binary cache when this device has built the same source before
+		program = buildProgram(context, device, LoadSource(kernel_file), "", &program_from_cache);
+
+		kernel_summary = cl::Kernel(program, "reduce_summary");
+		kernel_summary_partials = cl::Kernel(program, "reduce_summary_partials");
+		kernel_hist = cl::Kernel(program, "hist_atomic");
+		kernel_hist_local = cl::Kernel(program, "hist_local");
+		kernel_sum_compensated = cl::Kernel(program, "reduce_add_compensated");
+		kernel_sum_compensated_partials = cl::Kernel(program, "reduce_add_compensated_partials");
+		kernel_summary_by_key = cl::Kernel(program, "reduce_summary_by_key");
+		kernel_moments = cl::Kernel(program, "reduce_moments");
+		kernel_moments_partials = cl::Kernel(program, "reduce_moments_partials");
+		kernel_select = cl::Kernel(program, "radix_select_hist");
+
+		//one local size that suits every kernel, queried once
+		local_size = kernel_summary.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+		local_size = std::min(local_size, kernel_summary_partials.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size = std::min(local_size, kernel_hist.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size = std::min(local_size, kernel_hist_local.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size = std::min(local_size, kernel_sum_compensated.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size = std::min(local_size, kernel_sum_compensated_partials.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size = std::min(local_size, kernel_summary_by_key.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size = std::min(local_size, kernel_moments.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size = std::min(local_size, kernel_moments_partials.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size = std::min(local_size, kernel_select.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+
+		//the double kernels are only compiled when the device has cl_khr_fp64
+		double_supported = supportsDouble(device);
+		if (double_supported) {
+			kernel_sum_double = cl::Kernel(program, "reduce_add_double");
+			kernel_sum_double_partials = cl::Kernel(program, "reduce_add_double_partials");
+			local_size = std::min(local_size, kernel_sum_double.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+			local_size = std::min(local_size, kernel_sum_double_partials.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		}
+		mean_precision = PRECISION_COMPENSATED;
+		local_mem_size = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+		hist_method = HIST_AUTO;
+
+		//every family of reduction kernel is created up front so switching family later costs nothing
+		for (int variant = REDUCE_INTERLEAVED; variant <= REDUCE_UNROLLED; variant++) {
+			for (int op = REDUCE_ADD; op <= REDUCE_MAX; op++) {
+				reduce_kernels[variant][op] = cl::Kernel(program, reduceKernelName((ReduceOp)op, (ReduceVariant)variant));
+				local_size = std::min(local_size, reduce_kernels[variant][op].getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+			}
+		}
+		for (int op = REDUCE_ADD; op <= REDUCE_MAX; op++) {
+			scan_kernels[op] = cl::Kernel(program, scanKernelName((ReduceOp)op));
+			scan_offset_kernels[op] = cl::Kernel(program, scanOffsetKernelName((ReduceOp)op));
+			local_size = std::min(local_size, scan_kernels[op].getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+			local_size = std::min(local_size, scan_offset_kernels[op].getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		}
+		kernel_scan_int = cl::Kernel(program, "scan_add_int");
+		kernel_scan_offset_int = cl::Kernel(program, "scan_offset_add_int");
+		local_size = std::min(local_size, kernel_scan_int.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size = std::min(local_size, kernel_scan_offset_int.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		kernel_rolling_blocks = cl::Kernel(program, "rolling_blocks");
+		kernel_rolling_windows = cl::Kernel(program, "rolling_windows");
+		local_size = std::min(local_size, kernel_rolling_blocks.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size = std::min(local_size, kernel_rolling_windows.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size = powerOfTwoFloor(local_size); //needed by the sequential addressing and block scan kernels
+
+		compute_units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+		unrolled_supported = supportsUnrolledReduce(device, reduce_kernels[REDUCE_UNROLLED][REDUCE_ADD], local_size);
+
+		//default to the sequential family on every device, with the elements per item picked per query
+		//unrolled is only used when asked for (-r unrolled or the benchmark), as nothing in OpenCL promises the lockstep it relies on
+		ReduceConfig config = { REDUCE_SEQUENTIAL, 0 };
+		setReduceConfig(config);
+
+		//specialisations of the generic reduction are only built when a type and operator is first asked for
+		reduce_cache.init(context, SiblingPath(kernel_file, "reduce_generic.cl"));
+
+		partial_capacity = 0;
+		hist_capacity = 0;
+		keyed_capacity = 0;
+		buffer_select = cl::Buffer(context, CL_MEM_READ_WRITE, 256 * sizeof(cl_uint));
+	}
+
+	//put a dataset on the device once, returns the id to pass to the queries
+	//in_place wraps the host memory with CL_MEM_USE_HOST_PTR instead of copying it, so CPU and integrated devices read it directly
+	//the memory then has to stay valid and unchanged for as long as the engine is used (e.g. a mapped data cache)
+	//known_summary skips the first summary pass when it is already known (e.g. from cache zone maps)
+	int addDataset(DataView A, bool in_place = false, const Summary* known_summary = NULL)
+	{
+		const mytype* values = A.data();
+		size_t nr_elements = A.size();
+
+		Dataset dataset;
+		dataset.size = nr_elements;
+		dataset.type = ReduceType<mytype>::name();
+		dataset.has_summary = (known_summary != NULL);
+		if (known_summary)
+			dataset.summary = *known_summary;
+
+		size_t bytes = std::max(nr_elements, (size_t)1) * sizeof(mytype);
+		if (in_place && nr_elements) {
+			dataset.buffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, bytes, (void*)values);
+		}
+		else {
+			dataset.buffer = cl::Buffer(context, CL_MEM_READ_ONLY, bytes);
+			if (nr_elements)
+				queue.enqueueWriteBuffer(dataset.buffer, CL_TRUE, 0, nr_elements * sizeof(mytype), values, NULL,
+					profileEvent("write", nr_elements * sizeof(mytype)));
+		}
+
+		dataset.has_keys = false;
+		reservePartials(nr_elements);
+		datasets.push_back(dataset);
+
+		return (int)datasets.size() - 1;
+	}
+
+	//put values of another element type on the device, e.g. readings quantised to cl_int tenths of a degree, doubles or Half
+	//only reduce<T, Op> can query these, the other queries all expect float
+	template <typename T>
+	int addValues(const T* values, size_t nr_elements)
+	{
+		Dataset dataset;
+		dataset.size = nr_elements;
+		dataset.type = ReduceType<T>::name();
+		dataset.has_summary = false;
+		dataset.has_keys = false;
+
+		dataset.buffer = cl::Buffer(context, CL_MEM_READ_ONLY, std::max(nr_elements, (size_t)1) * sizeof(T));
+		if (nr_elements)
+			queue.enqueueWriteBuffer(dataset.buffer, CL_TRUE, 0, nr_elements * sizeof(T), values, NULL,
+				profileEvent("write", nr_elements * sizeof(T)));
+
+		reservePartials(nr_elements);
+		datasets.push_back(dataset);
+
+		return (int)datasets.size() - 1;
+	}
+
+	//release a dataset's device memory, its id is not reused so other ids stay valid
+	void removeDataset(int id)
+	{
+		datasets[id] = Dataset();
+		datasets[id].size = 0;
+		datasets[id].type = ReduceType<mytype>::name();
+		datasets[id].has_summary = false;
+		datasets[id].has_keys = false;
+	}
+
+	//min, max, sum and count of a dataset, worked out once and then remembered
+	Summary summary(int id)
+	{
+		Dataset& dataset = datasets[id];
+		if (!dataset.has_summary) {
+			dataset.summary = summaryOnDevice(queue, kernel_summary, kernel_summary_partials, local_size, dataset.buffer, dataset.size, buffer_B, buffer_C);
+			dataset.has_summary = true;
+		}
+		return dataset.summary;
+	}
+
+	//attach a key per value (1..16, e.g. the month of each reading) so summaryByKey can split the dataset without copying it apart
+	//in_place works as in addDataset
+	void setKeys(int id, const cl_uchar* keys, bool in_place = false)
+	{
+		Dataset& dataset = datasets[id];
+		size_t bytes = std::max(dataset.size, (size_t)1) * sizeof(cl_uchar);
+		if (in_place && dataset.size) {
+			dataset.keys = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, bytes, (void*)keys);
+		}
+		else {
+			dataset.keys = cl::Buffer(context, CL_MEM_READ_ONLY, bytes);
+			if (dataset.size)
+				queue.enqueueWriteBuffer(dataset.keys, CL_TRUE, 0, dataset.size * sizeof(cl_uchar), keys, NULL,
+					profileEvent("write", dataset.size * sizeof(cl_uchar)));
+		}
+		dataset.has_keys = true;
+		dataset.key_summaries.clear();
+	}
+
+	//min, max, sum and count of every key 1..nr_keys in one pass over the dataset, remembered like summary
+	vector<Summary> summaryByKey(int id, int nr_keys)
+	{
+		Dataset& dataset = datasets[id];
+		if (!dataset.has_keys)
+			throw cl::Error(CL_INVALID_VALUE, "Dataset has no keys, call setKeys first");
+
+		if ((int)dataset.key_summaries.size() != nr_keys) {
+			//enough groups to fill the device, each loops over its share of the data
+			size_t nr_groups = std::max(std::min(groupCount(dataset.size, local_size), compute_units * 8), (size_t)1);
+			size_t nr_partials = nr_groups * std::max(nr_keys, 1);
+			if (nr_partials > keyed_capacity) {
+				buffer_keyed = cl::Buffer(context, CL_MEM_READ_WRITE, nr_partials * sizeof(Summary));
+				keyed_capacity = nr_partials;
+			}
+			dataset.key_summaries = summaryByKeyOnDevice(queue, kernel_summary_by_key, local_size, nr_groups,
+				dataset.buffer, dataset.keys, dataset.size, nr_keys, buffer_keyed);
+		}
+		return dataset.key_summaries;
+	}
+
+	//pick the reduction kernel family and elements per work item used by min, max and mean
+	//asking for the unrolled family on a device that cannot run it safely falls back to sequential
+	void setReduceConfig(ReduceConfig config)
+	{
+		if ((config.variant == REDUCE_UNROLLED) && !unrolled_supported) {
+			std::cerr << "Unrolled reduction needs a GPU with a wavefront of 32 or more, using sequential instead" << std::endl;
+			config.variant = REDUCE_SEQUENTIAL;
+		}
+		reduce_config = config;
+	}
+
+	ReduceConfig getReduceConfig() const { return reduce_config; }
+	bool supportsUnrolled() const { return unrolled_supported; }
+
+	//pick how mean() accumulates its sum, double falls back to compensated on devices without cl_khr_fp64
+	void setMeanPrecision(MeanPrecision precision)
+	{
+		if ((precision == PRECISION_DOUBLE) && !double_supported) {
+			std::cerr << "Device does not support cl_khr_fp64, using compensated float sum for the mean instead" << std::endl;
+			precision = PRECISION_COMPENSATED;
+		}
+		mean_precision = precision;
+	}
+
+	MeanPrecision getMeanPrecision() const { return mean_precision; }
+
+	mytype min(int id) { return reduce(REDUCE_MIN, id); }
+	mytype max(int id) { return reduce(REDUCE_MAX, id); }
+	mytype sum(int id) { return reduce(REDUCE_ADD, id); }
+
+	//any operator over a dataset of element type T, e.g. reduce<cl_int, SumOp>(id) for quantised data
+	//the kernels for each (type, op) pair are built the first time it is used and kept for later calls
+	template <typename T, typename Op>
+	typename ReduceType<T>::Acc reduce(int id)
+	{
+		Dataset& dataset = datasets[id];
+		if (dataset.type != ReduceType<T>::name())
+			throw cl::Error(CL_INVALID_VALUE, "Dataset holds another element type");
+
+		ReduceKernels& kernels = reduce_cache.get<T, Op>();
+		size_t group_size = std::min(local_size, kernels.local_size);
+		size_t items = itemsPerWorkItem(reduce_config, dataset.size, group_size, compute_units);
+		reservePartialBytes(groupCount(dataset.size, group_size) * sizeof(typename ReduceType<T>::Acc));
+		return ::reduce<T, Op>(queue, kernels, group_size, dataset.buffer, dataset.size, buffer_B, buffer_C, items);
+	}
+
+	//mean of a dataset with the sum accumulated as set by setMeanPrecision, one pass over the data in every mode
+	double mean(int id)
+	{
+		Dataset& dataset = datasets[id];
+		size_t items = itemsPerWorkItem(reduce_config, dataset.size, local_size, compute_units);
+
+		if (mean_precision == PRECISION_COMPENSATED) {
+			FloatPair total = reducePartialsOnDevice<FloatPair>(queue, kernel_sum_compensated, kernel_sum_compensated_partials, local_size,
+				dataset.buffer, dataset.size, buffer_B, buffer_C, items);
+			return total.value() / dataset.size;
+		}
+		if (mean_precision == PRECISION_DOUBLE) {
+			cl_double total = reducePartialsOnDevice<cl_double>(queue, kernel_sum_double, kernel_sum_double_partials, local_size,
+				dataset.buffer, dataset.size, buffer_B, buffer_C, items);
+			return total / dataset.size;
+		}
+		return (double)sum(id) / dataset.size;
+	}
+
+	//count, mean and central moments of a dataset in one pass, for variance, standard deviation, skewness and kurtosis
+	Moments moments(int id)
+	{
+		Dataset& dataset = datasets[id];
+		size_t items = itemsPerWorkItem(reduce_config, dataset.size, local_size, compute_units);
+		return momentsOnDevice(queue, kernel_moments, kernel_moments_partials, local_size, dataset.buffer, dataset.size, buffer_B, buffer_C, items);
+	}
+
+	//values at fractions ps (0 to 1) of the sorted dataset, e.g. {0.05, 0.5, 0.95}, found by radix select without sorting
+	vector<double> percentiles(int id, const vector<double>& ps)
+	{
+		Dataset& dataset = datasets[id];
+		size_t nr_groups = std::max(std::min(groupCount(dataset.size, local_size), compute_units * 16), (size_t)1);
+		return percentilesOnDevice(queue, kernel_select, local_size, nr_groups, dataset.buffer, dataset.size, ps, buffer_select);
+	}
+
+	double median(int id) { return percentiles(id, vector<double>(1, 0.5))[0]; }
+
+	//histogram of a dataset with nr_bins equal width bins between its rounded min and max
+	Histogram histogram(int id, int nr_bins)
+	{
+		Summary s = summary(id);
+		float bin_min = floor(s.min); //find min value and round down
+		float bin_max = (ceil(s.max)) + 1; // find max value and round up then add 1 so the bins have whole number edges past the max
+		return histogram(id, uniformBins(bin_min, bin_max, nr_bins));
+	}
+
+	//histogram of a dataset with the given bin edges, values outside them go to underflow/overflow
+	Histogram histogram(int id, const vector<float>& edges)
+	{
+		return histogram(id, edgeBins(edges));
+	}
+
+	//histogram of a dataset with any bin layout
+	Histogram histogram(int id, const BinLayout& layout)
+	{
+		size_t nr_counters = histogramCounters(layout);
+		vector<int> H(nr_counters);
+		enqueueHistogramCounts(id, layout);
+		queue.enqueueReadBuffer(buffer_H, CL_TRUE, 0, sizeof(int) * nr_counters, &H[0], NULL, profileEvent("read histogram", sizeof(int) * nr_counters));
+		return makeHistogram(H, layout);
+	}
+
+	//running sum, min or max of a dataset in the order it was added (time order for the readings),
+	//e.g. the coldest reading so far at every reading, inclusive counts each value in its own result
+	vector<mytype> scan(int id, ReduceOp op, bool inclusive = true)
+	{
+		Dataset& dataset = datasets[id];
+		cl::Buffer buffer_scan(context, CL_MEM_READ_WRITE, std::max(dataset.size, (size_t)1) * sizeof(mytype));
+		vector<cl::Buffer> levels = scanBuffers<mytype>(context, dataset.size, local_size);
+		return scanOnDevice<mytype>(queue, scan_kernels[op], scan_offset_kernels[op], local_size, dataset.buffer, dataset.size, buffer_scan, inclusive, levels);
+	}
+
+	//cumulative distribution over nr_bins equal width bins between the dataset's rounded min and max, as histogram(id, nr_bins) bins it
+	vector<double> cdf(int id, int nr_bins)
+	{
+		Summary s = summary(id);
+		return cdf(id, uniformBins(floor(s.min), ceil(s.max) + 1, nr_bins));
+	}
+
+	//fraction of the dataset at or below the top edge of every bin, the counts are scanned where the histogram left them
+	vector<double> cdf(int id, const BinLayout& layout)
+	{
+		enqueueHistogramCounts(id, layout);
+		vector<cl::Buffer> levels = scanBuffers<cl_int>(context, layout.nr_bins, local_size);
+		return cdfOnDevice(queue, kernel_scan_int, kernel_scan_offset_int, local_size, buffer_H, layout, levels);
+	}
+
+	//force the global or local histogram kernel, local still falls back to global when the bins do not fit
+	void setHistogramMethod(HistogramMethod method) { hist_method = method; }
+	HistogramMethod getHistogramMethod() const { return hist_method; }
+
+	cl::Context& getContext() { return context; }
+	cl::CommandQueue& getQueue() { return queue; }
+	cl::Program& getProgram() { return program; }
+	cl::Device getDevice() const { return device; }
+	bool programFromCache() const { return program_from_cache; }
+	size_t getLocalSize() const { return local_size; }
+	size_t getComputeUnits() const { return compute_units; }
+	cl_ulong getLocalMemSize() const { return local_mem_size; }
+
+	//moving mean, min and max over every window of w consecutive values in the order the dataset was added,
+	//e.g. w = 24 for a day of hourly readings, the cost does not depend on w
+	Rolling rolling(int id, int w)
+	{
+		Dataset& dataset = datasets[id];
+		size_t nr_windows = rollingWindows(dataset.size, w);
+		if (!nr_windows)
+			throw cl::Error(CL_INVALID_VALUE, "Rolling window must be between 1 and the number of values");
+
+		//prefix and suffix results are as big as the dataset, so they only live for this call
+		cl::Buffer buffer_G(context, CL_MEM_READ_WRITE, 3 * dataset.size * sizeof(mytype));
+		cl::Buffer buffer_H(context, CL_MEM_READ_WRITE, 3 * dataset.size * sizeof(mytype));
+		cl::Buffer buffer_R(context, CL_MEM_READ_WRITE, 3 * nr_windows * sizeof(mytype));
+		return rollingOnDevice(queue, kernel_rolling_blocks, kernel_rolling_windows, local_size, dataset.buffer, dataset.size, w,
+			buffer_G, buffer_H, buffer_R);
+	}
+
+private:
+	//clears buffer_H and counts a dataset into it without reading the counts back, for histogram and cdf
+	void enqueueHistogramCounts(int id, const BinLayout& layout)
+	{
+		//only grow the histogram buffer when more bins are asked for than before
+		size_t nr_counters = histogramCounters(layout);
+		if (nr_counters > hist_capacity) {
+			buffer_H = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(int) * nr_counters);
+			hist_capacity = nr_counters;
+		}
+		buffer_edges = edgesBuffer(context, device, layout);
+
+		queue.enqueueFillBuffer(buffer_H, 0, 0, sizeof(int) * nr_counters, NULL, profileEvent("fill", sizeof(int) * nr_counters));
+
+		//local sub-histograms when they fit, the global kernel when they do not or when asked for
+		int copies = (hist_method == HIST_GLOBAL) ? 0 : histogramCopies(local_mem_size, layout, local_size);
+		if (copies)
+			enqueueHistogramLocal(queue, kernel_hist_local, local_size, compute_units * 16, datasets[id].buffer, datasets[id].size,
+				layout, copies, buffer_edges, buffer_H);
+		else
+			enqueueHistogram(queue, kernel_hist, local_size, datasets[id].buffer, datasets[id].size, layout, buffer_edges, buffer_H);
+	}
+
+	//runs one reduction over a dataset with the current kernel family
+	mytype reduce(ReduceOp op, int id)
+	{
+		size_t items = itemsPerWorkItem(reduce_config, datasets[id].size, local_size, compute_units);
+		return reduceOnDevice(queue, reduce_kernels[reduce_config.variant][op], local_size, datasets[id].buffer, datasets[id].size, buffer_B, buffer_C, items);
+	}
+
+	//a dataset that lives on the device
+	struct Dataset {
+		cl::Buffer buffer;
+		size_t size;
+		string type; //element type name, see ReduceType
+		bool has_summary;
+		Summary summary;
+		cl::Buffer keys; //one key per value, see setKeys
+		bool has_keys;
+		vector<Summary> key_summaries;
+	};
+
+	//make sure the partial result buffers can hold the first level of a reduction over nr_elements values
+	void reservePartials(size_t nr_elements)
+	{
+		//sized for the largest partial result
+		reservePartialBytes(groupCount(nr_elements, local_size) * std::max(sizeof(Summary), sizeof(Moments)));
+	}
+
+	//grow the partial result buffers to at least bytes each, e.g. for a generic reduction with a smaller work group
+	void reservePartialBytes(size_t bytes)
+	{
+		if (bytes <= partial_capacity)
+			return;
+
+		buffer_B = cl::Buffer(context, CL_MEM_READ_WRITE, bytes);
+		buffer_C = cl::Buffer(context, CL_MEM_READ_WRITE, bytes);
+		partial_capacity = bytes;
+	}
+
+	cl::Context context;
+	cl::Device device;
+	cl::CommandQueue queue;
+	cl::Program program;
+	bool program_from_cache;
+
+	cl::Kernel reduce_kernels[3][3]; //[ReduceVariant][ReduceOp]
+	ReduceKernelCache reduce_cache; //generic reduction per (type, op)
+	ReduceConfig reduce_config;
+	bool unrolled_supported;
+	size_t compute_units;
+	cl::Kernel kernel_summary, kernel_summary_partials;
+	cl::Kernel kernel_summary_by_key;
+	cl::Kernel kernel_moments, kernel_moments_partials;
+	cl::Kernel kernel_select;
+	cl::Buffer buffer_select; //radix select digit counts
+	cl::Kernel kernel_hist, kernel_hist_local;
+	cl::Kernel scan_kernels[3], scan_offset_kernels[3]; //[ReduceOp], float running sums and extremes
+	cl::Kernel kernel_scan_int, kernel_scan_offset_int; //histogram counts for cdf
+	cl::Kernel kernel_rolling_blocks, kernel_rolling_windows;
+	HistogramMethod hist_method;
+	cl_ulong local_mem_size;
+	cl::Kernel kernel_sum_compensated, kernel_sum_compensated_partials;
+	cl::Kernel kernel_sum_double, kernel_sum_double_partials;
+	bool double_supported;
+	MeanPrecision mean_precision;
+	size_t local_size;
+
+	cl::Buffer buffer_B, buffer_C; //partial results, shared by every query
+	size_t partial_capacity; //bytes
+	cl::Buffer buffer_H; //histogram counts
+	cl::Buffer buffer_edges; //bin edges of the last histogram, kept until its kernel has run
+	size_t hist_capacity;
+	cl::Buffer buffer_keyed; //per group partial summaries of summaryByKey
+	size_t keyed_capacity;
+
+	vector<Dataset> datasets;
+};
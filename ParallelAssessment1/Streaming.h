@@ -0,0 +1,330 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include "Functions.h"
+#include "StatsEngine.h"
+#include "DataLoader.h"
+#include "Sketch.h"
+
+#ifdef __APPLE__
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+//one block of parsed rows
+struct DataChunk {
+	vector<mytype> values;
+	vector<cl_uchar> months; //1-12, one per value
+};
+
+//fixed capacity queue between the parser thread and the device feeder
+//push blocks while the queue is full so the parser can never run more than capacity chunks ahead
+template <typename T>
+class BoundedQueue {
+public:
+	BoundedQueue(size_t capacity) : capacity(capacity), closed(false), cancelled(false) {}
+
+	//false once the consumer has cancelled, the item is dropped and the producer should stop
+	bool push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this]() { return (items.size() < capacity) || cancelled; });
+		if (cancelled)
+			return false;
+		items.push_back(std::move(item));
+		not_empty.notify_one();
+		return true;
+	}
+
+	//false once the queue is closed and everything has been taken out
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [this]() { return !items.empty() || closed; });
+		if (items.empty())
+			return false;
+		item = std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	//no more items will be pushed
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		not_empty.notify_all();
+	}
+
+	//the consumer will not take any more items, e.g. it failed, so a blocked push returns and nothing is queued again
+	void cancel()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancelled = true;
+		items.clear();
+		not_full.notify_all();
+		not_empty.notify_all();
+	}
+
+private:
+	size_t capacity;
+	bool closed;
+	bool cancelled;
+	std::deque<T> items;
+	std::mutex mutex;
+	std::condition_variable not_empty, not_full;
+};
+
+//reads up to chunk_elements rows of the temperature file, same columns as populate_data
+//returns false when there was nothing left to read
+bool readChunk(ifstream& file, size_t chunk_elements, DataChunk& chunk)
+{
+	chunk.values.clear();
+	chunk.months.clear();
+	chunk.values.reserve(chunk_elements);
+	chunk.months.reserve(chunk_elements);
+
+	string line;
+	while ((chunk.values.size() < chunk_elements) && getline(file, line))
+	{
+		float val; int monthID;
+		if (!parseRow(line.data(), line.data() + line.size(), val, monthID))
+			continue; //blank or malformed row
+		chunk.values.push_back(val);
+		chunk.months.push_back((cl_uchar)monthID);
+	}
+	return !chunk.values.empty();
+}
+
+//min/max/sum/count folded together from per chunk summaries, the sum is carried in double on the host
+struct RunningSummary {
+	float min;
+	float max;
+	double sum;
+	size_t count;
+
+	RunningSummary() : min(INFINITY), max(-INFINITY), sum(0), count(0) {}
+
+	void add(const Summary& s)
+	{
+		if (!s.count)
+			return;
+		min = std::min(min, (float)s.min);
+		max = std::max(max, (float)s.max);
+		sum += s.sum;
+		count += s.count;
+	}
+
+	double mean() const { return sum / count; }
+};
+
+//everything one streamed pass produces
+struct StreamResult {
+	RunningSummary summary;
+	Histogram histogram; //only filled when a bin layout was given
+	QuantileSketch sketch; //only filled when a sketch error bound was given
+	size_t nr_chunks;
+};
+
+//streams a data file through the device in fixed size chunks so memory stays bounded whatever the file size
+//a parser thread reads chunks ahead while earlier ones upload on one queue and reduce on another,
+//each chunk has its own device buffer (nr_slots of them) so an upload never waits for the previous chunk's kernels
+class StreamingStats {
+public:
+	StreamingStats(StatsEngine& engine, size_t chunk_elements = 1 << 20, int nr_slots = 3)
+		: engine(engine), chunk_elements(chunk_elements), nr_slots(std::max(nr_slots, 2))
+	{
+		cl::Context& context = engine.getContext();
+		cl::Device device = engine.getDevice();
+
+		//separate queues so uploads and kernels overlap on devices with a copy engine
+		upload_queue = cl::CommandQueue(context, device);
+		compute_queue = cl::CommandQueue(context, device);
+
+		kernel_summary = cl::Kernel(engine.getProgram(), "reduce_summary");
+		kernel_summary_partials = cl::Kernel(engine.getProgram(), "reduce_summary_partials");
+		kernel_hist = cl::Kernel(engine.getProgram(), "hist_atomic");
+		kernel_hist_local = cl::Kernel(engine.getProgram(), "hist_local");
+		kernel_sketch = cl::Kernel(engine.getProgram(), "sketch_block");
+		sketch_local_size = std::min(engine.getLocalSize(), kernel_sketch.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		sketch_block = sketchBlockSize(engine.getLocalMemSize());
+
+		//partial buffers are shared by every chunk as the compute queue runs one chunk after the other
+		size_t nr_groups = groupCount(chunk_elements, engine.getLocalSize());
+		buffer_B = cl::Buffer(context, CL_MEM_READ_WRITE, nr_groups * sizeof(Summary));
+		buffer_C = cl::Buffer(context, CL_MEM_READ_WRITE, nr_groups * sizeof(Summary));
+
+		slots.resize(this->nr_slots);
+		for (size_t i = 0; i < slots.size(); i++)
+			slots[i].buffer = cl::Buffer(context, CL_MEM_READ_ONLY, chunk_elements * sizeof(mytype));
+	}
+
+	//one pass over the file, with a histogram too when layout is given (the bins have to be known up front)
+	//and approximate quantiles within a rank error of about sketch_epsilon when it is above 0
+	StreamResult run(const string& file_name, const BinLayout* layout = NULL, double sketch_epsilon = 0)
+	{
+		ifstream file(file_name);
+		if (file.fail())
+			throw cl::Error(CL_INVALID_VALUE, "Could not open the data file to stream");
+
+		StreamResult result;
+		result.nr_chunks = 0;
+
+		cl::Context& context = engine.getContext();
+		size_t local_size = engine.getLocalSize();
+
+		//histogram counts stay on the device and add up chunk after chunk
+		cl::Buffer buffer_edges, buffer_H;
+		int copies = 0;
+		if (layout) {
+			buffer_edges = edgesBuffer(context, engine.getDevice(), *layout);
+			buffer_H = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(int) * histogramCounters(*layout));
+			compute_queue.enqueueFillBuffer(buffer_H, 0, 0, sizeof(int) * histogramCounters(*layout));
+			copies = histogramCopies(engine.getLocalMemSize(), *layout, local_size);
+		}
+
+		//every chunk's samples go into one sketch as they come back
+		size_t sketch_samples = 0;
+		cl::Buffer buffer_S;
+		if (sketch_epsilon > 0) {
+			result.sketch = QuantileSketch(QuantileSketch::capacityFor(sketch_epsilon));
+			sketch_samples = sketchSamples(result.sketch, sketch_block);
+			buffer_S = cl::Buffer(context, CL_MEM_WRITE_ONLY, groupCount(chunk_elements, sketch_block) * sketch_samples * sizeof(float));
+		}
+		sketch_level = sketch_samples ? sketchLevel(sketch_block, sketch_samples) : 0;
+
+		//parser runs ahead by at most nr_slots chunks
+		BoundedQueue<DataChunk> chunks(nr_slots);
+		std::thread parser([&]() {
+			DataChunk chunk;
+			while (readChunk(file, chunk_elements, chunk) && chunks.push(std::move(chunk)))
+				;
+			chunks.close();
+		});
+		ParserGuard guard(chunks, parser);
+
+		for (size_t i = 0; i < slots.size(); i++)
+			slots[i].busy = false;
+
+		DataChunk chunk;
+		size_t next_slot = 0;
+		while (chunks.pop(chunk)) {
+			Slot& slot = slots[next_slot];
+			next_slot = (next_slot + 1) % slots.size();
+
+			//the slot's last chunk must be finished before its host data and buffer are reused
+			finishSlot(slot, result);
+
+			slot.chunk = std::move(chunk);
+			size_t nr_elements = slot.chunk.values.size();
+
+			//upload without blocking, the kernels wait for it on the other queue
+			vector<cl::Event> uploaded(1);
+			upload_queue.enqueueWriteBuffer(slot.buffer, CL_FALSE, 0, nr_elements * sizeof(mytype), &slot.chunk.values[0], NULL, &uploaded[0]);
+
+			cl::Buffer buffer_result = enqueueReducePartials<Summary>(compute_queue, kernel_summary, kernel_summary_partials, local_size,
+				slot.buffer, nr_elements, buffer_B, buffer_C, 1, &uploaded);
+
+			if (layout) {
+				if (copies)
+					enqueueHistogramLocal(compute_queue, kernel_hist_local, local_size, engine.getComputeUnits() * 16, slot.buffer, nr_elements,
+						*layout, copies, buffer_edges, buffer_H);
+				else
+					enqueueHistogram(compute_queue, kernel_hist, local_size, slot.buffer, nr_elements, *layout, buffer_edges, buffer_H);
+			}
+
+			//the samples come back with the summary, the in order queue keeps buffer_S safe until they are read
+			slot.samples.clear();
+			if (sketch_samples) {
+				enqueueSketch(compute_queue, kernel_sketch, sketch_local_size, slot.buffer, nr_elements, sketch_block, sketch_samples, buffer_S,
+					(cl_uint)result.nr_chunks + 1);
+				slot.samples.resize(groupCount(nr_elements, sketch_block) * sketch_samples);
+				compute_queue.enqueueReadBuffer(buffer_S, CL_FALSE, 0, slot.samples.size() * sizeof(float), &slot.samples[0]);
+			}
+
+			//only the chunk's summary comes back, picked up when the slot is next needed
+			compute_queue.enqueueReadBuffer(buffer_result, CL_FALSE, 0, sizeof(Summary), &slot.result, NULL, &slot.done);
+			slot.busy = true;
+
+			upload_queue.flush();
+			compute_queue.flush();
+			result.nr_chunks++;
+		}
+		parser.join();
+
+		//fold in the chunks still in flight
+		for (size_t i = 0; i < slots.size(); i++)
+			finishSlot(slots[(next_slot + i) % slots.size()], result);
+
+		if (layout) {
+			vector<int> H(histogramCounters(*layout));
+			compute_queue.enqueueReadBuffer(buffer_H, CL_TRUE, 0, sizeof(int) * H.size(), &H[0]);
+			result.histogram = makeHistogram(H, *layout);
+		}
+
+		return result;
+	}
+
+private:
+	//stops and joins the parser however run is left, a cl::Error thrown past a joinable std::thread would call std::terminate
+	//cancelling first lets a parser blocked on a full queue return, as nothing takes chunks out any more
+	struct ParserGuard {
+		BoundedQueue<DataChunk>& chunks;
+		std::thread& parser;
+
+		ParserGuard(BoundedQueue<DataChunk>& chunks, std::thread& parser) : chunks(chunks), parser(parser) {}
+		~ParserGuard()
+		{
+			if (parser.joinable()) {
+				chunks.cancel();
+				parser.join();
+			}
+		}
+	};
+
+	//host and device storage for one chunk in flight
+	struct Slot {
+		DataChunk chunk;
+		cl::Buffer buffer;
+		cl::Event done; //summary (and sketch samples) read back
+		Summary result;
+		vector<float> samples;
+		bool busy;
+	};
+
+	//wait for the slot's chunk and fold its summary into the running one
+	void finishSlot(Slot& slot, StreamResult& result)
+	{
+		if (!slot.busy)
+			return;
+		slot.done.wait();
+		result.summary.add(slot.result);
+		if (!slot.samples.empty())
+			result.sketch.add(&slot.samples[0], slot.samples.size(), sketch_level);
+		slot.busy = false;
+	}
+
+	StatsEngine& engine;
+	size_t chunk_elements;
+	int nr_slots;
+
+	cl::CommandQueue upload_queue, compute_queue;
+	cl::Kernel kernel_summary, kernel_summary_partials;
+	cl::Kernel kernel_hist, kernel_hist_local;
+	cl::Kernel kernel_sketch;
+	size_t sketch_local_size, sketch_block;
+	int sketch_level;
+	cl::Buffer buffer_B, buffer_C;
+	vector<Slot> slots;
+};
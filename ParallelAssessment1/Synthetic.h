@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+#include "DataLoader.h"
+
+//shapes of made up temperature data, for timing and checking the kernels without the real file
+enum SyntheticShape {
+	SHAPE_SEASONAL, //normal around a mean that follows the months, like the Lincolnshire readings
+	SHAPE_UNIFORM, //even spread from -20 to 40, every histogram bin gets about the same count
+	SHAPE_SKEWED, //long warm tail, most values bunch up in a few bins
+	SHAPE_OUTLIERS //seasonal with 1 in 1000 readings far out, stretches the bins and the min/max
+};
+
+const char* syntheticShapeName(SyntheticShape shape)
+{
+	switch (shape) {
+	case SHAPE_UNIFORM: return "uniform";
+	case SHAPE_SKEWED: return "skewed";
+	case SHAPE_OUTLIERS: return "outliers";
+	default: return "seasonal";
+	}
+}
+
+//parse a shape given on the command line, false for anything unknown
+bool parseSyntheticShape(const string& name, SyntheticShape& shape)
+{
+	for (int s = SHAPE_SEASONAL; s <= SHAPE_OUTLIERS; s++) {
+		if (name == syntheticShapeName((SyntheticShape)s)) {
+			shape = (SyntheticShape)s;
+			return true;
+		}
+	}
+	return false;
+}
+
+//rows generated from one seed, so the data does not depend on how many threads made it
+#define SYNTHETIC_BLOCK_ROWS 65536
+
+//nr_rows readings of the given shape, rounded to 0.1 degrees like the real file so values repeat
+//the months cycle through the year in blocks of rows, the same seed always gives the same data
+TemperatureData generateTemperatures(size_t nr_rows, SyntheticShape shape, unsigned int seed = 1)
+{
+	TemperatureData data;
+	data.values.resize(nr_rows);
+	data.months.resize(nr_rows);
+
+	size_t nr_blocks = (nr_rows + SYNTHETIC_BLOCK_ROWS - 1) / SYNTHETIC_BLOCK_ROWS;
+	unsigned int nr_threads = (unsigned int)std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), std::max(nr_blocks, (size_t)1));
+
+	vector<std::thread> threads;
+	for (unsigned int t = 0; t < nr_threads; t++) {
+		threads.push_back(std::thread([&, t]() {
+			for (size_t b = t; b < nr_blocks; b += nr_threads) {
+				std::mt19937 random(seed * 2654435761u + (unsigned int)b);
+				std::normal_distribution<float> noise(0.0f, 4.0f);
+				std::uniform_real_distribution<float> uniform(-20.0f, 40.0f);
+				std::gamma_distribution<float> tail(2.0f, 4.0f);
+				std::uniform_int_distribution<int> rare(0, 999);
+
+				size_t begin = b * SYNTHETIC_BLOCK_ROWS, end = std::min(begin + SYNTHETIC_BLOCK_ROWS, nr_rows);
+				for (size_t i = begin; i < end; i++) {
+					int month = (int)((i / 31) % 12) + 1; //a month of daily readings at a time
+					float seasonal = 10.0f - 7.0f * cos((month - 1) * 3.14159265f / 6.0f) + noise(random);
+
+					float val;
+					if (shape == SHAPE_UNIFORM)
+						val = uniform(random);
+					else if (shape == SHAPE_SKEWED)
+						val = tail(random) - 5.0f;
+					else if ((shape == SHAPE_OUTLIERS) && !rare(random))
+						val = seasonal + ((random() & 1) ? 500.0f : -500.0f);
+					else
+						val = seasonal;
+
+					data.values[i] = floor(val * 10.0f + 0.5f) / 10.0f;
+					data.months[i] = (cl_uchar)month;
+				}
+			}
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	return data;
+}
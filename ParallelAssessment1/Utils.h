@@ -4,6 +4,7 @@
 #include <vector>
 #include <iostream>
 #include <sstream>
+#include <iterator>
 
 #ifdef __APPLE__
 #include <OpenCL/cl.hpp>
@@ -120,10 +121,18 @@ void CheckError(cl_int error) {
 	}
 }
 
-void AddSources(cl::Program::Sources& sources, const string& file_name) {
-	//TODO: add file existence check
-	string* source_code = new string(istreambuf_iterator<char>(ifstream(file_name)), (istreambuf_iterator<char>()));
-	sources.push_back(make_pair((*source_code).c_str(), source_code->length() + 1));
+//whole kernel source file as a string, the caller keeps it alive for as long as cl::Program::Sources point into it
+string LoadSource(const string& file_name) {
+	ifstream file(file_name); //a named stream, istreambuf_iterator cannot take a temporary on every compiler
+	if (!file)
+		throw cl::Error(CL_INVALID_VALUE, "Could not open the kernel file");
+	return string(istreambuf_iterator<char>(file), (istreambuf_iterator<char>()));
+}
+
+//path of another file in the same folder as file_name, e.g. a second kernel file next to my_kernels.cl
+string SiblingPath(const string& file_name, const string& sibling) {
+	size_t slash = file_name.find_last_of("/\\");
+	return (slash == string::npos) ? sibling : file_name.substr(0, slash + 1) + sibling;
 }
 
 string ListPlatformsDevices() {
@@ -7,17 +7,31 @@
 #include <string>
 #include <sstream>
 #include <future>
+#include <limits>
+#include <chrono>
 
 
 #include <CL/cl.hpp>
 #include "Utils.h"
 #include "Functions.h" // file with all host code functions
+#include "StatsEngine.h" // keeps device, kernels and data alive between queries
+#include "Benchmark.h" // timing of the kernel variants
+#include "Streaming.h" // chunked processing of files too big to load
+#include "Sketch.h" // approximate quantiles in bounded memory
+#include "DataLoader.h" // fast parsing of the data file
+#include "DataCache.h" // binary copy of the parsed file for later runs
+#include "Profiler.h" // per stage times of the enqueued commands
+#include "Backend.h" // native CPU statistics when there is no device or little data
+#include "MultiDevice.h" // one dataset split over every device
+#include "ProgramCache.h" // compiled kernels kept on disk between runs
+#include "Batch.h" // many queries answered with one wait for the device
+#include "LiveStats.h" // summaries kept current as new readings are appended
 
 using namespace std;
 
 typedef float mytype;
-vector<mytype> A; // input data vector
-vector<vector<mytype>> months(12); // input data split to months
+TemperatureCache dataset; // input data columns, mapped from the binary cache
+const string data_file = "../temp_lincolnshire.txt";
 
 void print_help() {
 	cerr << "Application usage:" << endl;
@@ -25,28 +39,47 @@ void print_help() {
 	cerr << "  -p : select platform " << endl;
 	cerr << "  -d : select device" << endl;
 	cerr << "  -l : list all platforms and devices" << endl;
+	cerr << "  -r : reduction kernels to use (interleaved, sequential, unrolled), sequential by default, unrolled assumes lockstep wavefronts and is for benchmarking" << endl;
+	cerr << "  -e : elements each work item reduces (0 picks automatically)" << endl;
+	cerr << "  -m : precision of the mean (float, compensated, double)" << endl;
+	cerr << "  -s : stream the file in chunks of this many values and show the full data summaries" << endl;
+	cerr << "  -b : benchmark the reduction, mean precision and histogram kernels and the file loader instead of showing the menu" << endl;
+	cerr << "  --profile [file] : time every write, kernel and read of one pass over the full data, saved as .json or .csv when a file is given" << endl;
+	cerr << "  --peak : device memory bandwidth in GB/s the profile compares against" << endl;
+	cerr << "  --multi : split the full data over every device (--split also splits CPU devices by affinity domain) and show the summaries" << endl;
+	cerr << "  --backend : where the menu statistics run (auto, opencl, native), auto uses native threads for small data or when there is no device" << endl;
+	cerr << "  --cache : folder the compiled kernels are kept in between runs (default kernel_cache), --no-cache always compiles them" << endl;
+	cerr << "  --batch : answer the queries in a file (one per line, e.g. \"month=3 histogram 20\") as JSON lines instead of showing the menu" << endl;
+	cerr << "  --query : one more query for the batch, can be given several times" << endl;
+	cerr << "  --batch-out : file the batch answers are written to instead of the console" << endl;
+	cerr << "  --rolling : moving mean, min and max over windows of this many readings, e.g. 24,168,720 for a day, week and month of hourly readings" << endl;
+	cerr << "  --live : replay the file as a live feed appended this many readings at a time, only each new block is reduced" << endl;
 	cerr << "  -h : print this message" << endl;
 }
 
-//function to read in data from text file and set to vectors
+//function to read in data from the binary cache, parsing the text file first if there is no up to date cache
 void populate_data() {
-	   ifstream file("../temp_lincolnshire.txt");
-	   if (file.fail()) { //check file exists
+	   if (!loadTemperatureCached(data_file, dataset)) { //check file exists
 		   cout << endl << "File does not exist!" << endl;
 		   system("pause");
 		   exit(EXIT_FAILURE);
 	   }
+}
 
-	   string   line;
+//puts the full data and its month column on the device, reading them in place and with the summary taken from the zone maps
+int add_full_data(StatsEngine& engine) {
+	   Summary summary;
+	   bool has_summary = zoneSummary(dataset, summary);
+	   int id = engine.addDataset(dataset.view(), true, has_summary ? &summary : NULL);
+	   engine.setKeys(id, dataset.months(), true);
+	   return id;
+}
 
-	   while (getline(file, line))
-	   {
-		   istringstream linestream(line);
-		   float val; int monthID; string tmp;
-		   linestream >> tmp >> tmp >> monthID >> tmp >> tmp >> val;
-		   A.push_back(val);
-		   months[monthID - 1].push_back(val);
-	   }
+//the menu's device backend gets the min and max from the zone maps, so its summary needs no pass over the data
+void add_zone_summary(OpenCLBackend& device) {
+	   Summary summary;
+	   if (zoneSummary(dataset, summary))
+		   device.setKnownSummary(dataset.view(), summary);
 }
 
 int main(int argc, char **argv)
@@ -54,54 +87,315 @@ int main(int argc, char **argv)
 	//Part 1 - handle command line options such as device selection, verbosity, etc.
 	int platform_id = 0;
 	int device_id = 0;
-	cl::Context context; cl::CommandQueue queue; cl::Program program;
+	StatsEngine engine;
+	string reduce_variant; // empty keeps the engine's choice
+	int reduce_items = 0;
+	string mean_precision; // empty keeps compensated
+	bool benchmark = false;
+	size_t stream_chunk = 0; // 0 loads the whole file instead
+	bool profile = false;
+	string profile_file; // empty only prints the profile
+	double peak_bandwidth = 0;
+	BackendKind backend = BACKEND_AUTO;
+	bool device_ready = false; // false when no OpenCL device could be set up
+	double build_ms = 0; // time to get the kernels ready
+	bool multi = false;
+	bool split_cpus = false;
+	string batch_file; // queries to answer in one batch
+	vector<string> batch_queries; // more queries from the command line
+	string batch_out; // empty prints the answers
+	vector<int> rolling_windows; // window lengths in readings
+	size_t live_chunk = 0; // 0 is no live feed
 
 	for (int i = 1; i < argc; i++) {
 		if ((strcmp(argv[i], "-p") == 0) && (i < (argc - 1))) { platform_id = atoi(argv[++i]); }
 		else if ((strcmp(argv[i], "-d") == 0) && (i < (argc - 1))) { device_id = atoi(argv[++i]); }
 		else if (strcmp(argv[i], "-l") == 0) { std::cout << ListPlatformsDevices() << endl; }
+		else if ((strcmp(argv[i], "-r") == 0) && (i < (argc - 1))) { reduce_variant = argv[++i]; }
+		else if ((strcmp(argv[i], "-e") == 0) && (i < (argc - 1))) { reduce_items = atoi(argv[++i]); }
+		else if ((strcmp(argv[i], "-m") == 0) && (i < (argc - 1))) { mean_precision = argv[++i]; }
+		else if ((strcmp(argv[i], "-s") == 0) && (i < (argc - 1))) { stream_chunk = atol(argv[++i]); }
+		else if (strcmp(argv[i], "-b") == 0) { benchmark = true; }
+		else if (strcmp(argv[i], "--profile") == 0) {
+			profile = true;
+			if ((i < (argc - 1)) && (argv[i + 1][0] != '-')) { profile_file = argv[++i]; }
+		}
+		else if ((strcmp(argv[i], "--peak") == 0) && (i < (argc - 1))) { peak_bandwidth = atof(argv[++i]); }
+		else if (strcmp(argv[i], "--multi") == 0) { multi = true; }
+		else if (strcmp(argv[i], "--split") == 0) { multi = true; split_cpus = true; }
+		else if ((strcmp(argv[i], "--backend") == 0) && (i < (argc - 1))) { backend = parseBackend(argv[++i]); }
+		else if ((strcmp(argv[i], "--cache") == 0) && (i < (argc - 1))) { program_cache_dir = argv[++i]; }
+		else if (strcmp(argv[i], "--no-cache") == 0) { program_cache_dir.clear(); }
+		else if ((strcmp(argv[i], "--batch") == 0) && (i < (argc - 1))) { batch_file = argv[++i]; }
+		else if ((strcmp(argv[i], "--query") == 0) && (i < (argc - 1))) { batch_queries.push_back(argv[++i]); }
+		else if ((strcmp(argv[i], "--batch-out") == 0) && (i < (argc - 1))) { batch_out = argv[++i]; }
+		else if ((strcmp(argv[i], "--rolling") == 0) && (i < (argc - 1))) {
+			istringstream list(argv[++i]);
+			string w;
+			while (getline(list, w, ','))
+				rolling_windows.push_back(atoi(w.c_str()));
+		}
+		else if ((strcmp(argv[i], "--live") == 0) && (i < (argc - 1))) { live_chunk = atol(argv[++i]); }
 		else if (strcmp(argv[i], "-h") == 0) { print_help(); }
 	}
 
 	//Part 1.1 - Load the data on a different thread so menu can be shown when data is loading...
-	std::future<void> result = async(launch::async, populate_data);
+	//streaming reads the file itself chunk by chunk so nothing is loaded up front
+	std::future<void> result;
+	if (!stream_chunk && !live_chunk)
+		result = async(launch::async, populate_data);
 	std::cout << "        *----------------------* David's Parallel Temp Stats *----------------------*" << endl;
 
 	//detect any potential exceptions
 	try {
 		//Part 2 - host operations
-		//2.1 Select computing devices
-		context = GetContext(platform_id, device_id);
+		//select computing device, create the queue and build the device code once (or load it from the cache)
+		auto build_start = std::chrono::high_resolution_clock::now();
+		engine.init(platform_id, device_id, "my_kernels.cl", profile);
+		build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - build_start).count();
+
+		//override the reduction kernels the engine picked for this device
+		if (!reduce_variant.empty() || reduce_items) {
+			ReduceConfig config = engine.getReduceConfig();
+			if (!reduce_variant.empty())
+				config.variant = parseReduceVariant(reduce_variant);
+			config.items_per_work_item = reduce_items;
+			engine.setReduceConfig(config);
+		}
+		if (!mean_precision.empty())
+			engine.setMeanPrecision(parseMeanPrecision(mean_precision));
+		device_ready = true;
+	}
+	catch (cl::Error err) {
+		std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+	}
 
-		//display the selected device
+	if (device_ready) {
+		std::cout << "        *-----------------* Running on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << " *------------------*" << std::endl;
+		std::cout << "        Kernels " << (engine.programFromCache() ? "loaded from " + program_cache_dir : string("compiled")) << " in " << build_ms << " ms" << std::endl << endl;
+	}
+	else
+		std::cout << "        *-----------------* Running on the host CPU, " << nativeDescription() << " *------------------*" << std::endl << endl;
 
-		//create a queue to which we will push commands for the device
-		queue = cl::CommandQueue(context);
+	//the other modes time or stream through the device, so they need one
+	bool batch = !batch_file.empty() || !batch_queries.empty();
+	if (!device_ready && (stream_chunk || benchmark || profile || batch || !rolling_windows.empty() || live_chunk)) {
+		std::cerr << "Streaming, benchmark, profile, batch, rolling and live modes need an OpenCL device" << std::endl;
+		return 1;
+	}
 
-		//2.2 Load & build the device code
-		cl::Program::Sources sources;
+	//streaming skips the menu, it only has one pass over the file
+	if (stream_chunk) {
+		try {
+			StreamingStats stream(engine, stream_chunk);
+			StreamResult streamed = stream.run(data_file, NULL, 0.001); // quantiles within 0.1% of rank
+
+			std::cout << "-----------------------------------" << std::endl;
+			std::cout << "Full Data Summaries (" << streamed.nr_chunks << " chunks)" << std::endl;
+			std::cout << "-----------------------------------" << std::endl;
+			std::cout << "Min Value = " << streamed.summary.min << std::endl;
+			std::cout << "Mean Value = " << streamed.summary.mean() << std::endl;
+			std::cout << "Max Value = " << streamed.summary.max << std::endl;
+			std::cout << "5th Percentile ~ " << streamed.sketch.quantile(0.05) << std::endl;
+			std::cout << "Median ~ " << streamed.sketch.quantile(0.5) << std::endl;
+			std::cout << "95th Percentile ~ " << streamed.sketch.quantile(0.95) << std::endl;
+			std::cout << "-----------------------------------" << std::endl;
+		}
+		catch (cl::Error err) {
+			std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+		}
+		system("pause");
+		return 0;
+	}
 
-		AddSources(sources, "my_kernels.cl");
+	//live skips the menu, the file arrives block by block as if the stations were sending it and the summaries stay current after every block
+	if (live_chunk) {
+		try {
+			ifstream file(data_file);
+			if (file.fail())
+				throw cl::Error(CL_INVALID_VALUE, "Could not open the data file to replay");
+
+			LiveStats live(engine);
+			int hist_id = live.addHistogram(uniformBins(-20, 40, 12)); // every 5 degrees, colder or warmer readings go to under/overflow
+			DataChunk chunk;
+			double append_ms = 0;
+			while (readChunk(file, live_chunk, chunk)) {
+				auto start = std::chrono::high_resolution_clock::now();
+				live.append(chunk);
+				append_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			}
 
-		program = cl::Program(context, sources);
+			const RunningSummary& summary = live.summary();
+			std::cout << "-----------------------------------" << std::endl;
+			std::cout << "Live Summaries (" << live.appends() << " appends of up to " << live_chunk << " readings, "
+				<< append_ms / std::max(live.appends(), (size_t)1) << " ms each)" << std::endl;
+			std::cout << "-----------------------------------" << std::endl;
+			std::cout << "Count = " << summary.count << std::endl;
+			std::cout << "Min Value = " << summary.min << std::endl;
+			std::cout << "Mean Value = " << summary.mean() << std::endl;
+			std::cout << "Max Value = " << summary.max << std::endl;
+			std::cout << "Month\tMin\tMean\tMax\tCount" << std::endl;
+			for (int m = 1; m <= 12; m++) {
+				const RunningSummary& month = live.month(m);
+				if (month.count)
+					std::cout << m << "\t" << month.min << "\t" << month.mean() << "\t" << month.max << "\t" << month.count << std::endl;
+				else
+					std::cout << m << "\t-\t-\t-\t0" << std::endl;
+			}
+			printHistogram(live.histogram(hist_id));
+		}
+		catch (cl::Error err) {
+			std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+		}
+		return 0;
+	}
 
-		//build and debug the kernel code
+	//multi device skips the menu, every device works on its own slice of the full data at the same time
+	if (multi) {
 		try {
-			program.build();
+			result.get(); // make sure different thread data load is done
+			MultiDeviceStats devices;
+			devices.init(allDevices(split_cpus));
+			devices.setData(dataset.view());
+
+			RunningSummary summary = devices.summary();
+			double mean = devices.mean();
+			Histogram histogram = devices.histogram(10);
+
+			std::cout << "-----------------------------------" << std::endl;
+			std::cout << "Full Data Summaries (" << devices.nrDevices() << " devices)" << std::endl;
+			std::cout << "-----------------------------------" << std::endl;
+			std::cout << "Min Value = " << summary.min << std::endl;
+			std::cout << "Mean Value = " << mean << std::endl;
+			std::cout << "Max Value = " << summary.max << std::endl;
+			printHistogram(histogram);
+			devices.printDevices(std::cout); // slices as they will be for the next query
 		}
-		catch (const cl::Error& err) {
-			std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			throw err;
+		catch (cl::Error err) {
+			std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
 		}
+		return 0;
+	}
 
+	//batch skips the menu, every query is planned together and answered after one wait for the device
+	if (batch) {
+		try {
+			vector<BatchQuery> queries;
+			if (!batch_file.empty()) {
+				ifstream in(batch_file);
+				if (!in) {
+					std::cerr << "Could not open the query file " << batch_file << std::endl;
+					return 1;
+				}
+				queries = readBatchQueries(in);
+			}
+			for (size_t i = 0; i < batch_queries.size(); i++)
+				queries.push_back(parseBatchQuery(batch_queries[i]));
+
+			result.get(); // make sure different thread data load is done
+			Summary summary;
+			bool has_summary = zoneSummary(dataset, summary);
+			BatchRunner runner(engine);
+			vector<BatchResult> answers = runner.run(queries, dataset.view(), dataset.months(), has_summary ? &summary : NULL);
+
+			std::cout << queries.size() << " queries answered with " << runner.uploads() << " uploads and " << runner.passes() << " passes" << std::endl;
+			if (batch_out.empty())
+				std::cout << batchJson(queries, answers);
+			else {
+				ofstream out(batch_out);
+				out << batchJson(queries, answers);
+				std::cout << "Answers written to " << batch_out << std::endl;
+			}
+		}
+		catch (cl::Error err) {
+			std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+		}
+		return 0;
 	}
-	catch (cl::Error err) {
-		std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+
+	//rolling skips the menu, every window length runs over the whole series in file order
+	if (!rolling_windows.empty()) {
+		try {
+			result.get(); // make sure different thread data load is done
+			int id = add_full_data(engine);
+
+			std::cout << "--------------------------------------------------------------" << std::endl;
+			std::cout << "Rolling Windows (in readings, file order)" << std::endl;
+			std::cout << "--------------------------------------------------------------" << std::endl;
+			std::cout << "Window\tLowest Mean\tHighest Mean\tLargest Range" << std::endl;
+			for (size_t i = 0; i < rolling_windows.size(); i++) {
+				Rolling rolling = engine.rolling(id, rolling_windows[i]);
+
+				//where the moving mean peaks and where one window swings the most, by the reading each window starts at
+				size_t lowest = 0, highest = 0, widest = 0;
+				for (size_t k = 1; k < rolling.mean.size(); k++) {
+					if (rolling.mean[k] < rolling.mean[lowest]) lowest = k;
+					if (rolling.mean[k] > rolling.mean[highest]) highest = k;
+					if (rolling.max[k] - rolling.min[k] > rolling.max[widest] - rolling.min[widest]) widest = k;
+				}
+				std::cout << rolling.window << "\t" << rolling.mean[lowest] << " @" << lowest << "\t" << rolling.mean[highest] << " @" << highest
+					<< "\t" << rolling.max[widest] - rolling.min[widest] << " @" << widest << std::endl;
+			}
+			std::cout << "--------------------------------------------------------------" << std::endl;
+		}
+		catch (cl::Error err) {
+			std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+		}
+		return 0;
+	}
+
+	//benchmark skips the menu and exits when done
+	if (benchmark) {
+		try {
+			result.get(); // make sure different thread data load is done
+			DataView A = dataset.view(); // the mapped cache, nothing is copied on the host
+			int id = engine.addDataset(A); // uploaded once and shared by every benchmark
+			benchmarkReduceVariants(engine, id, A);
+			benchmarkMeanPrecision(engine, id, A);
+			benchmarkHistogram(engine, id, A);
+			benchmarkLoader(data_file);
+		}
+		catch (cl::Error err) {
+			std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+		}
+		return 0;
 	}
 
-	std::cout << "        *-----------------* Running on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << " *------------------*" << std::endl << endl;
+	//profile skips the menu, runs every full data query once and reports where the time went
+	if (profile) {
+		try {
+			result.get(); // make sure different thread data load is done
+			Profiler profiler;
+			profiler.setPeakBandwidth(peak_bandwidth);
+			active_profiler = &profiler;
+
+			DataView A = dataset.view();
+			int id = engine.addDataset(A); // copied so the upload shows up as a stage
+			engine.setKeys(id, dataset.months());
+			engine.summary(id);
+			engine.mean(id);
+			engine.moments(id);
+			vector<double> ps = { 0.05, 0.5, 0.95 };
+			engine.percentiles(id, ps);
+			engine.summaryByKey(id, 12);
+			engine.histogram(id, 100);
+			engine.getQueue().finish();
+
+			active_profiler = NULL;
+			profiler.print(std::cout);
+			if (!profile_file.empty()) {
+				ofstream out(profile_file);
+				bool csv = (profile_file.size() >= 4) && (profile_file.compare(profile_file.size() - 4, 4, ".csv") == 0);
+				out << (csv ? profiler.csv() : profiler.json());
+				if (out.fail())
+					std::cerr << "Could not write the profile to " << profile_file << std::endl;
+			}
+		}
+		catch (cl::Error err) {
+			std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+		}
+		return 0;
+	}
 	
 	//show main menu and input from user
 	int menuInput = 1;
@@ -121,75 +415,102 @@ int main(int argc, char **argv)
 		else
 			cout << "Invalid value given, please choose a number from 1-3!" << endl;
 	}
+	//every menu query goes through one backend, native threads or the device picked by the size of the data
+	OpenCLBackend device(engine);
+	AutoBackend stats(device_ready ? &device : NULL, backend);
+
 	//show full data results
 	if (menuInput == 1)
 	{
 		result.get(); // make sure different thread data load is done
+		add_zone_summary(device);
+
+		DataView A = dataset.view();
+		vector<double> ps = { 0.05, 0.5, 0.95 };
+		Summary summary = stats.summary(A); // min and max from one pass
+		double mean = stats.mean(A); // uses the chosen precision on the device
+		Moments moments = stats.moments(A); // spread and shape from one more pass
+		vector<double> percentiles = stats.percentiles(A, ps); // exact, found without sorting
 
 		std::cout << "-----------------------------------" << std::endl;
 		std::cout << "Full Data Summaries" << std::endl;
 		std::cout << "-----------------------------------" << std::endl;
-		std::cout << "Min Value = " << parallelMin(context, program, queue, A) << std::endl;
-		std::cout << "Mean Value = " << parallelMean(context, program, queue, A) << std::endl;
-		std::cout << "Max Value = " << parallelMax(context, program, queue, A) << std::endl;
+		std::cout << "Min Value = " << summary.min << std::endl;
+		std::cout << "Mean Value = " << mean << std::endl;
+		std::cout << "Max Value = " << summary.max << std::endl;
+		std::cout << "Variance = " << moments.variance() << std::endl;
+		std::cout << "Std Deviation = " << moments.stdDev() << std::endl;
+		std::cout << "Skewness = " << moments.skewness() << std::endl;
+		std::cout << "Kurtosis = " << moments.kurtosis() << std::endl;
+		std::cout << "5th Percentile = " << percentiles[0] << std::endl;
+		std::cout << "Median = " << percentiles[1] << std::endl;
+		std::cout << "95th Percentile = " << percentiles[2] << std::endl;
 		std::cout << "-----------------------------------" << std::endl;
 	}
 	else if (menuInput == 2)
 	{
-		//ask user for which month to do 
-		int monthChosen = 0;
-		bool hasMonth = false;
-		while (!hasMonth)
-		{
-			std::cout << "--------------------------------------------------------------" << std::endl;
-			std::cout << "Monthly Data Summaries" << std::endl;
-			std::cout << "--------------------------------------------------------------" << std::endl;
-			cout << "Which month would you like to see summaries of? (1-12)" << endl;
-			std::cout << "--------------------------------------------------------------" << std::endl;
-			cin >> monthChosen;
-
-			if ((monthChosen <= 12) && (monthChosen > 0))
-			{
-				hasMonth = true;
-			}
-			else
-			{
-				cout << "Invalid value given, please choose a number from 1-12!" << endl << endl;
-			}
-		
-		}
-
 		result.get();// make sure different thread data load is done
+		add_zone_summary(device);
 
-		//show chosen months min/avg/max
-		std::cout << "-----------------------------------" << std::endl;
-		std::cout << "Month " << monthChosen << " Data Summaries" << std::endl;
-		std::cout << "-----------------------------------" << std::endl;
-		std::cout << "Min Value = " << parallelMin(context, program, queue, months[monthChosen - 1]) << std::endl;
-		std::cout << "Mean Value = " << parallelMean(context, program, queue, months[monthChosen - 1]) << std::endl;
-		std::cout << "Max Value = " << parallelMax(context, program, queue, months[monthChosen - 1]) << std::endl;
-		std::cout << "-----------------------------------" << std::endl;
-
+		//every month from one pass over the full data, split by the month column
+		vector<Summary> monthly = stats.summaryByKey(dataset.view(), dataset.months(), 12);
 
+		std::cout << "--------------------------------------------------------------" << std::endl;
+		std::cout << "Monthly Data Summaries" << std::endl;
+		std::cout << "--------------------------------------------------------------" << std::endl;
+		std::cout << "Month\tMin\tMean\tMax\tCount" << std::endl;
+		for (int m = 0; m < 12; m++)
+		{
+			if (monthly[m].count)
+				std::cout << m + 1 << "\t" << monthly[m].min << "\t" << monthly[m].mean() << "\t" << monthly[m].max << "\t" << monthly[m].count << std::endl;
+			else
+				std::cout << m + 1 << "\t-\t-\t-\t0" << std::endl;
+		}
+		std::cout << "--------------------------------------------------------------" << std::endl;
 	}
 	//show histogram menu
 	else
 	{
-		//Ask user for number of bins wanted
+		//Ask user for number of bins wanted, or for their own bin edges
 		int binsChosen = 0;
+		vector<float> edgesChosen;
 		bool hasBins = false;
 		while (!hasBins)
 		{
 			std::cout << "--------------------------------------------------------------" << std::endl;
 			std::cout << "Full Data Histogram" << std::endl;
 			std::cout << "--------------------------------------------------------------" << std::endl;
-			cout << "How many bins would you like for this histogram?" << endl;
+			cout << "How many bins would you like for this histogram? (0 to enter your own bin edges)" << endl;
 			std::cout << "--------------------------------------------------------------" << std::endl;
 			cin >> binsChosen;
 
-			if ((binsChosen < 1) || cin.fail())
+			if ((binsChosen < 0) || cin.fail())
 			{
 				cout << "Invalid value given, please choose a integer greater than 0!" << endl << endl;
+				cin.clear();
+				cin.ignore(numeric_limits<streamsize>::max(), '\n');
+			}
+			else if (binsChosen == 0)
+			{
+				//read all edges from one line
+				cout << "Enter the bin edges in increasing order on one line:" << endl;
+				cin.ignore(numeric_limits<streamsize>::max(), '\n');
+				string line;
+				getline(cin, line);
+				istringstream linestream(line);
+				float edge;
+				edgesChosen.clear();
+				while (linestream >> edge)
+					edgesChosen.push_back(edge);
+
+				bool increasing = edgesChosen.size() >= 2;
+				for (size_t i = 1; i < edgesChosen.size(); i++)
+					increasing = increasing && (edgesChosen[i - 1] < edgesChosen[i]);
+
+				if (increasing)
+					hasBins = true;
+				else
+					cout << "Invalid edges given, please give at least two increasing values!" << endl << endl;
 			}
 			else
 			{
@@ -198,8 +519,12 @@ int main(int argc, char **argv)
 
 		}
 		result.get();// make sure different thread data load is done
-		//create histogram using nr of bins chosen by user (this is in functions.h)
-		parallelHistogram(context, program, queue, A, binsChosen);
+		add_zone_summary(device);
+		//create histogram using nr of bins or the edges chosen by user
+		if (binsChosen)
+			printHistogram(stats.histogram(dataset.view(), binsChosen));
+		else
+			printHistogram(stats.histogram(dataset.view(), edgeBins(edgesChosen)));
 	}
 
 	system("pause");
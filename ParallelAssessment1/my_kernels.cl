@@ -1,11 +1,11 @@
-__kernel void reduce_add_6(__global float* A, __local float* scratch) {
+__kernel void reduce_add_6(__global const float* A, __global float* B, __local float* scratch, const int nr_elements) {
 	int id = get_global_id(0); //global id
 	int lid = get_local_id(0); //local id
 	int N = get_local_size(0); // number of elements
 	const uint group_id = get_group_id(0);//get global work item id
 
-	//cache all N values from global memory to local memory
-	scratch[lid] = A[id];
+	//cache all N values from global memory to local memory, items past the end of the input use 0 as it does not affect addition
+	scratch[lid] = (id < nr_elements) ? A[id] : 0;
 
 	barrier(CLK_LOCAL_MEM_FENCE);//wait for all local threads to finish copying from global to local memory
 
@@ -17,17 +17,17 @@ __kernel void reduce_add_6(__global float* A, __local float* scratch) {
 	}
 
 	//copy the sum of work group to output array in position of work item id
-	if (lid == 0) A[group_id] = scratch[0];
+	if (lid == 0) B[group_id] = scratch[0];
 }
 
-__kernel void reduce_max(__global float* A, __local float* scratch) {
+__kernel void reduce_max(__global const float* A, __global float* B, __local float* scratch, const int nr_elements) {
 	int id = get_global_id(0);
 	int lid = get_local_id(0);
 	int N = get_local_size(0);
 	const uint group_id = get_group_id(0);
 
-	//cache all N values from global memory to local memory
-	scratch[lid] = A[id];
+	//cache all N values from global memory to local memory, items past the end of the input use -INFINITY as the neutral value for max
+	scratch[lid] = (id < nr_elements) ? A[id] : -INFINITY;
 
 	barrier(CLK_LOCAL_MEM_FENCE);//wait for all local threads to finish copying from global to local memory
 
@@ -41,18 +41,18 @@ __kernel void reduce_max(__global float* A, __local float* scratch) {
 	}
 
 	//copy the cache to output array in position of work item id
-	if (!lid)  A[group_id] = scratch[0];
+	if (!lid)  B[group_id] = scratch[0];
 
 }
 
-__kernel void reduce_min(__global float* A, __local float* scratch) {
+__kernel void reduce_min(__global const float* A, __global float* B, __local float* scratch, const int nr_elements) {
 	int id = get_global_id(0);
 	int lid = get_local_id(0);
 	int N = get_local_size(0);
 	const uint group_id = get_group_id(0);
 
-	//cache all N values from global memory to local memory
-	scratch[lid] = A[id];
+	//cache all N values from global memory to local memory, items past the end of the input use INFINITY as the neutral value for min
+	scratch[lid] = (id < nr_elements) ? A[id] : INFINITY;
 
 	barrier(CLK_LOCAL_MEM_FENCE);//wait for all local threads to finish copying from global to local memory
 
@@ -66,23 +66,720 @@ __kernel void reduce_min(__global float* A, __local float* scratch) {
 	}
 
 	//copy the cache to output array in position of work item id
-	if (!lid)  A[group_id] = scratch[0];
+	if (!lid)  B[group_id] = scratch[0];
 
 }
 
+//histograms have nr_bins + 2 counters: the bins themselves, then underflow (index nr_bins) and overflow (index nr_bins + 1)
+#define UNDERFLOW_BIN(nr_bins) (nr_bins)
+#define OVERFLOW_BIN(nr_bins) ((nr_bins) + 1)
+
+//bin of a value for nr_bins equal width bins starting at min
 int bin_index(const float val, const float min, const int nr_bins, const float bin_width)
 {
-	int index = ((val - min) / bin_width); // returns index of given value in bin H vector
-	if (index >= nr_bins || index < 0) // check bin index is within H vector
-	{
-		index = nr_bins; // return index outside of H so it isn't counted
+	float pos = (val - min) / bin_width; // position of the value in bin widths
+	if (pos < 0)
+		return UNDERFLOW_BIN(nr_bins); // below the first bin
+	if (!(pos < nr_bins))
+		return OVERFLOW_BIN(nr_bins); // above the last bin, also catches NaN
+	return (int)pos; //return calculated index
+}
+
+//bin of a value for nr_bins bins with nr_bins + 1 increasing edges, bin i is edges[i] to edges[i + 1]
+//the last bin also includes its top edge, found by binary search so the cost is log2(nr_bins) per value
+int bin_index_edges(const float val, __constant const float* edges, const int nr_bins)
+{
+	if (val < edges[0])
+		return UNDERFLOW_BIN(nr_bins);
+	if (!(val <= edges[nr_bins]))
+		return OVERFLOW_BIN(nr_bins); // also catches NaN
+
+	//largest i with edges[i] <= val
+	int lo = 0, hi = nr_bins;
+	while (hi - lo > 1) {
+		int mid = (lo + hi) / 2;
+		if (edges[mid] <= val)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+//picks the equal width or the edge lookup, use_edges is the same for every work item so there is no divergence
+int hist_bin(const float val, const float min, const int nr_bins, const float bin_width, __constant const float* edges, const int use_edges)
+{
+	return use_edges ? bin_index_edges(val, edges, nr_bins) : bin_index(val, min, nr_bins, bin_width);
+}
+
+// hist kernal, H has nr_bins + 2 counters so values outside the bins land in the underflow/overflow counters
+__kernel void hist_atomic(__global const float* A, __global int* H, const int nr_elements, const int nr_bins, const float bin_width, const float min,
+	__constant const float* edges, const int use_edges) {
+	int id = get_global_id(0);
+
+	//work items past the end of the input have nothing to count
+	if (id >= nr_elements)
+		return;
+
+	// atomically increment Historgram vector from bin id returned from hist_bin function
+	atomic_inc(&H[hist_bin(A[id], min, nr_bins, bin_width, edges, use_edges)]);
+}
+
+//summary of a block of values, min/max/sum/count reduced together in one pass
+typedef struct {
+	float min;
+	float max;
+	float sum;
+	uint count;
+} summary;
+
+//combine two summaries into the first one
+void summary_merge(__local summary* a, __local const summary* b)
+{
+	if (a->min > b->min) a->min = b->min; //keep smaller min
+	if (a->max < b->max) a->max = b->max; //keep bigger max
+	a->sum += b->sum;
+	a->count += b->count;
+}
+
+//reduce the summaries held in scratch down to scratch[0] and write it out for this work group
+void summary_reduce_local(__local summary* scratch, __global summary* B)
+{
+	int lid = get_local_id(0);
+	int N = get_local_size(0);
+
+	for (int i = 1; i < N; i *= 2) { //strides
+		if (!(lid % (i * 2)) && ((lid + i) < N))
+			summary_merge(&scratch[lid], &scratch[lid + i]);
+
+		barrier(CLK_LOCAL_MEM_FENCE);//wait for all local threads to finish merging
 	}
-	return index; //return calculated index
+
+	//copy the summary of work group to output array in position of group id
+	if (!lid) B[get_group_id(0)] = scratch[0];
 }
-// hist kernal
-__kernel void hist_atomic(__global const float* A, __global const int* nr_bins, __global const float* bin_width, __global const float* min, __global int* H) {
+
+// fused min/max/sum/count kernel, reads the raw values once and writes one summary per work group
+__kernel void reduce_summary(__global const float* A, __global summary* B, __local summary* scratch, const int N) {
+	int id = get_global_id(0);
+	int lid = get_local_id(0);
+
+	//cache value into local memory, items past the end of the data get neutral values so they do not affect any of the results
+	if (id < N) {
+		scratch[lid].min = A[id];
+		scratch[lid].max = A[id];
+		scratch[lid].sum = A[id];
+		scratch[lid].count = 1;
+	}
+	else {
+		scratch[lid].min = INFINITY;
+		scratch[lid].max = -INFINITY;
+		scratch[lid].sum = 0;
+		scratch[lid].count = 0;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);//wait for all local threads to finish copying from global to local memory
+
+	summary_reduce_local(scratch, B);
+}
+
+// merges the per work group summaries produced by reduce_summary until only one is left
+__kernel void reduce_summary_partials(__global const summary* A, __global summary* B, __local summary* scratch, const int N) {
 	int id = get_global_id(0);
+	int lid = get_local_id(0);
+
+	if (id < N) {
+		scratch[lid] = A[id];
+	}
+	else {
+		scratch[lid].min = INFINITY;
+		scratch[lid].max = -INFINITY;
+		scratch[lid].sum = 0;
+		scratch[lid].count = 0;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);//wait for all local threads to finish copying from global to local memory
+
+	summary_reduce_local(scratch, B);
+}
+
+
+//most keys reduce_summary_by_key can handle, each work item keeps one private summary per key
+#define MAX_KEYS 16
+
+// segmented min/max/sum/count: one summary per key for every key in a single pass over the data
+// keys[i] says which group A[i] belongs to (1..nr_keys, anything else is skipped), e.g. the month of each reading
+// each work item folds a grid-stride slice into its private summaries, then the work group reduces them key by key
+// and writes B[group * nr_keys + key - 1], local size must be a power of two
+__kernel void reduce_summary_by_key(__global const float* A, __global const uchar* keys, __global summary* B, __local summary* scratch,
+	const int nr_elements, const int nr_keys) {
+	int lid = get_local_id(0);
+	int N = get_local_size(0);
+
+	summary mine[MAX_KEYS];
+	for (int k = 0; k < nr_keys; k++) {
+		mine[k].min = INFINITY;
+		mine[k].max = -INFINITY;
+		mine[k].sum = 0;
+		mine[k].count = 0;
+	}
+
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0)) {
+		uint k = keys[i] - 1;
+		if (k < (uint)nr_keys) {
+			float val = A[i];
+			mine[k].min = fmin(mine[k].min, val);
+			mine[k].max = fmax(mine[k].max, val);
+			mine[k].sum += val;
+			mine[k].count++;
+		}
+	}
+
+	//sequential addressing reduction of every key in turn through the same scratch space
+	for (int k = 0; k < nr_keys; k++) {
+		scratch[lid] = mine[k];
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		for (int s = N / 2; s > 0; s >>= 1) {
+			if (lid < s)
+				summary_merge(&scratch[lid], &scratch[lid + s]);
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+
+		if (!lid) B[get_group_id(0) * nr_keys + k] = scratch[0];
+		barrier(CLK_LOCAL_MEM_FENCE); //scratch is reused by the next key
+	}
+}
+
+//reduction operators shared by the sequential addressing kernels below
+#define OP_ADD(a, b) ((a) + (b))
+#define OP_MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define OP_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+//each work item first folds many elements into a register using a grid-stride loop,
+//so the number of work groups (and partial results) shrinks by the number of elements per item
+#define GRID_STRIDE_ACCUMULATE(OP, NEUTRAL) \
+	float acc = NEUTRAL; \
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0)) \
+		acc = OP(acc, A[i]); \
+	scratch[lid] = acc; \
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+//sequential addressing: active work items stay contiguous (lid < s) so whole wavefronts retire together
+//and neighbouring items read neighbouring local memory words, local size must be a power of two
+#define REDUCE_SEQ_KERNEL(NAME, OP, NEUTRAL) \
+__kernel void NAME(__global const float* A, __global float* B, __local float* scratch, const int nr_elements) { \
+	int lid = get_local_id(0); \
+	GRID_STRIDE_ACCUMULATE(OP, NEUTRAL) \
+	for (int s = get_local_size(0) / 2; s > 0; s >>= 1) { \
+		if (lid < s) \
+			scratch[lid] = OP(scratch[lid], scratch[lid + s]); \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+	} \
+	if (!lid) B[get_group_id(0)] = scratch[0]; \
+}
+
+//as above but the last 64 -> 1 steps run inside a single wavefront without barriers,
+//only valid on devices that execute 32 or more work items in lockstep and with a local size of at least 64
+//that is a data race under the OpenCL memory model, so these are a benchmark variant only and never the default
+#define REDUCE_UNROLLED_KERNEL(NAME, OP, NEUTRAL) \
+__kernel void NAME(__global const float* A, __global float* B, __local float* scratch, const int nr_elements) { \
+	int lid = get_local_id(0); \
+	GRID_STRIDE_ACCUMULATE(OP, NEUTRAL) \
+	for (int s = get_local_size(0) / 2; s > 32; s >>= 1) { \
+		if (lid < s) \
+			scratch[lid] = OP(scratch[lid], scratch[lid + s]); \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+	} \
+	if (lid < 32) { \
+		volatile __local float* w = scratch; \
+		w[lid] = OP(w[lid], w[lid + 32]); \
+		w[lid] = OP(w[lid], w[lid + 16]); \
+		w[lid] = OP(w[lid], w[lid + 8]); \
+		w[lid] = OP(w[lid], w[lid + 4]); \
+		w[lid] = OP(w[lid], w[lid + 2]); \
+		w[lid] = OP(w[lid], w[lid + 1]); \
+	} \
+	if (!lid) B[get_group_id(0)] = scratch[0]; \
+}
+
+REDUCE_SEQ_KERNEL(reduce_add_seq, OP_ADD, 0.0f)
+REDUCE_SEQ_KERNEL(reduce_min_seq, OP_MIN, INFINITY)
+REDUCE_SEQ_KERNEL(reduce_max_seq, OP_MAX, -INFINITY)
+
+REDUCE_UNROLLED_KERNEL(reduce_add_unrolled, OP_ADD, 0.0f)
+REDUCE_UNROLLED_KERNEL(reduce_min_unrolled, OP_MIN, INFINITY)
+REDUCE_UNROLLED_KERNEL(reduce_max_unrolled, OP_MAX, -INFINITY)
+
+
+//unevaluated sum hi + lo of two floats, lo holds the rounding error hi could not keep (double-float)
+typedef struct {
+	float hi;
+	float lo;
+} float_pair;
+
+//error free sum of a and b (Knuth two-sum), exact for any ordering of magnitudes
+float_pair two_sum(float a, float b)
+{
+	float_pair r;
+	r.hi = a + b;
+	float bb = r.hi - a;
+	r.lo = (a - (r.hi - bb)) + (b - bb);
+	return r;
+}
+
+//add two double-float values keeping the error terms of both
+float_pair pair_add(float_pair a, float_pair b)
+{
+	float_pair s = two_sum(a.hi, b.hi);
+	s.lo += a.lo + b.lo;
+	return two_sum(s.hi, s.lo); //renormalise so hi carries as much as it can
+}
+
+//merge the pairs held in scratch down to scratch[0], local size must be a power of two
+void pair_reduce_local(__local float_pair* scratch, __global float_pair* B)
+{
+	int lid = get_local_id(0);
+
+	for (int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+		if (lid < s)
+			scratch[lid] = pair_add(scratch[lid], scratch[lid + s]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (!lid) B[get_group_id(0)] = scratch[0];
+}
+
+//compensated sum, each work item keeps a running double-float sum over its grid-stride slice so
+//the rounding error of every addition is carried along instead of being lost
+__kernel void reduce_add_compensated(__global const float* A, __global float_pair* B, __local float_pair* scratch, const int nr_elements) {
+	int lid = get_local_id(0);
+
+	float_pair acc = { 0.0f, 0.0f };
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0)) {
+		float_pair s = two_sum(acc.hi, A[i]);
+		s.lo += acc.lo;
+		acc = s;
+	}
+	scratch[lid] = acc;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	pair_reduce_local(scratch, B);
+}
+
+//merges the double-float partial sums from reduce_add_compensated until one is left
+__kernel void reduce_add_compensated_partials(__global const float_pair* A, __global float_pair* B, __local float_pair* scratch, const int nr_elements) {
+	int lid = get_local_id(0);
+
+	float_pair acc = { 0.0f, 0.0f };
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0))
+		acc = pair_add(acc, A[i]);
+	scratch[lid] = acc;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	pair_reduce_local(scratch, B);
+}
+
+//double precision sum, only built when the device supports doubles
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+
+void double_reduce_local(__local double* scratch, __global double* B)
+{
+	int lid = get_local_id(0);
 
-	// atomically increment Historgram vector from bin id returned from bin_index function
-	atomic_inc(&H[bin_index(A[id], *min, *nr_bins, *bin_width)]);
-}
\ No newline at end of file
+	for (int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+		if (lid < s)
+			scratch[lid] += scratch[lid + s];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (!lid) B[get_group_id(0)] = scratch[0];
+}
+
+__kernel void reduce_add_double(__global const float* A, __global double* B, __local double* scratch, const int nr_elements) {
+	double acc = 0;
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0))
+		acc += A[i];
+	scratch[get_local_id(0)] = acc;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	double_reduce_local(scratch, B);
+}
+
+__kernel void reduce_add_double_partials(__global const double* A, __global double* B, __local double* scratch, const int nr_elements) {
+	double acc = 0;
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0))
+		acc += A[i];
+	scratch[get_local_id(0)] = acc;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	double_reduce_local(scratch, B);
+}
+#endif
+
+
+// hist kernel with per work group sub-histograms in local memory, so the hot bins are only hit by
+// the work items of one group and the global histogram sees one atomic add per bin per group
+// LH holds 'copies' sub-histograms of nr_bins + 2 counters each, work items spread over them by local id so
+// neighbouring items (same wavefront) do not all fight over the same local counter
+__kernel void hist_local(__global const float* A, __global int* H, __local int* LH, const int nr_elements, const int nr_bins, const float bin_width, const float min,
+	__constant const float* edges, const int use_edges, const int copies) {
+	int lid = get_local_id(0);
+	int N = get_local_size(0);
+	int nr_counters = nr_bins + 2; //bins plus underflow and overflow
+	int total_counters = nr_counters * copies;
+
+	//clear the local sub-histograms
+	for (int i = lid; i < total_counters; i += N)
+		LH[i] = 0;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	//grid-stride loop so each group counts a large slice and the merge cost is spread over many elements
+	__local int* my_copy = LH + (lid % copies) * nr_counters;
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0))
+		atomic_inc(&my_copy[hist_bin(A[i], min, nr_bins, bin_width, edges, use_edges)]);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	//fold the copies together and add the group's counts to the global histogram
+	for (int b = lid; b < nr_counters; b += N) {
+		int count = 0;
+		for (int c = 0; c < copies; c++)
+			count += LH[c * nr_counters + b];
+		if (count)
+			atomic_add(&H[b], count);
+	}
+}
+
+//running count, mean and central moment sums M2..M4 of a block of values (Welford/Chan form)
+//the sums are kept around the block's own mean so merging big blocks does not lose digits the way sum of powers does
+typedef struct {
+	uint n;
+	float mean;
+	float m2;
+	float m3;
+	float m4;
+} moments;
+
+//moments of a and b together (Chan et al. / Pebay pairwise update)
+moments moments_merge(moments a, moments b)
+{
+	if (b.n == 0) return a;
+	if (a.n == 0) return b;
+
+	moments r;
+	float na = a.n, nb = b.n;
+	float n = na + nb;
+	float delta = b.mean - a.mean;
+	float d_n = delta / n;
+	float d_n2 = d_n * d_n;
+	float term = delta * d_n * na * nb;
+
+	r.n = a.n + b.n;
+	r.mean = a.mean + d_n * nb;
+	r.m2 = a.m2 + b.m2 + term;
+	r.m3 = a.m3 + b.m3 + term * d_n * (na - nb) + 3.0f * d_n * (na * b.m2 - nb * a.m2);
+	r.m4 = a.m4 + b.m4 + term * d_n2 * (na * na - na * nb + nb * nb)
+		+ 6.0f * d_n2 * (na * na * b.m2 + nb * nb * a.m2) + 4.0f * d_n * (na * b.m3 - nb * a.m3);
+	return r;
+}
+
+//add one value to the moments, the Welford update
+moments moments_add(moments a, float x)
+{
+	float n = a.n + 1;
+	float delta = x - a.mean;
+	float d_n = delta / n;
+	float d_n2 = d_n * d_n;
+	float term = delta * d_n * (n - 1.0f);
+
+	moments r;
+	r.n = a.n + 1;
+	r.mean = a.mean + d_n;
+	r.m4 = a.m4 + term * d_n2 * (n * n - 3.0f * n + 3.0f) + 6.0f * d_n2 * a.m2 - 4.0f * d_n * a.m3;
+	r.m3 = a.m3 + term * d_n * (n - 2.0f) - 3.0f * d_n * a.m2;
+	r.m2 = a.m2 + term;
+	return r;
+}
+
+//sequential addressing reduction of the moments in scratch, writes one per work group
+void moments_reduce_local(__local moments* scratch, __global moments* B)
+{
+	int lid = get_local_id(0);
+
+	for (int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+		if (lid < s)
+			scratch[lid] = moments_merge(scratch[lid], scratch[lid + s]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (!lid) B[get_group_id(0)] = scratch[0];
+}
+
+// count, mean and M2..M4 in one pass, each work item runs Welford over a grid-stride slice
+__kernel void reduce_moments(__global const float* A, __global moments* B, __local moments* scratch, const int nr_elements) {
+	int lid = get_local_id(0);
+
+	moments acc = { 0, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0))
+		acc = moments_add(acc, A[i]);
+	scratch[lid] = acc;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	moments_reduce_local(scratch, B);
+}
+
+//merges the per work group moments from reduce_moments until one is left
+__kernel void reduce_moments_partials(__global const moments* A, __global moments* B, __local moments* scratch, const int nr_elements) {
+	int lid = get_local_id(0);
+
+	moments acc = { 0, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0))
+		acc = moments_merge(acc, A[i]);
+	scratch[lid] = acc;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	moments_reduce_local(scratch, B);
+}
+
+//order preserving map from float to uint, so larger floats give larger keys (negatives have all bits flipped)
+uint float_key(float f)
+{
+	uint u = as_uint(f);
+	return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+// radix select: 256 bin histogram of the 8 bit digit at 'shift' of every key whose higher digits match prefix (under prefix_mask)
+// the host walks the counts to find which digit holds the wanted rank and narrows the prefix, 4 passes find any rank exactly
+// without sorting, local counters per group with one global atomic per non-empty bin
+__kernel void radix_select_hist(__global const float* A, __global uint* H, __local uint* LH, const int nr_elements,
+	const uint prefix, const uint prefix_mask, const int shift) {
+	int lid = get_local_id(0);
+	int N = get_local_size(0);
+
+	for (int i = lid; i < 256; i += N)
+		LH[i] = 0;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0)) {
+		uint key = float_key(A[i]);
+		if ((key & prefix_mask) == prefix)
+			atomic_inc(&LH[(key >> shift) & 0xFF]);
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int i = lid; i < 256; i += N)
+		if (LH[i])
+			atomic_add(&H[i], LH[i]);
+}
+
+// one compare-exchange step of a bitonic sort over a power of two sized buffer, one work item per element
+// k is the length of the bitonic sequences being merged and j the distance between compared elements
+__kernel void sort_bitonic_step(__global float* A, const uint j, const uint k) {
+	uint i = get_global_id(0);
+	uint partner = i ^ j;
+
+	if (partner > i) {
+		float a = A[i];
+		float b = A[partner];
+		bool ascending = ((i & k) == 0);
+		if ((a > b) == ascending) {
+			A[i] = b;
+			A[partner] = a;
+		}
+	}
+}
+
+// the remaining steps j = j_start .. 1 of one merge stage in local memory, valid while j_start < local size
+// so each work group only compares elements of its own block and all these steps cost one launch
+__kernel void sort_bitonic_local(__global float* A, __local float* scratch, const uint j_start, const uint k) {
+	uint i = get_global_id(0);
+	uint lid = get_local_id(0);
+	bool ascending = ((i & k) == 0);
+
+	scratch[lid] = A[i];
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint j = j_start; j > 0; j >>= 1) {
+		uint partner = lid ^ j;
+		if (partner > lid) {
+			float a = scratch[lid];
+			float b = scratch[partner];
+			if ((a > b) == ascending) {
+				scratch[lid] = b;
+				scratch[partner] = a;
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	A[i] = scratch[lid];
+}
+
+// first compaction of a quantile sketch, each work group sorts one block of 'block' values of A in local memory
+// (bitonic, block a power of two) and keeps every w-th of them, w = block / samples, starting at a random offset
+// each kept value then stands for w values, S gets 'samples' values per group with NAN where the block ran out of data
+// the host carries on compacting these level by level (see QuantileSketch)
+__kernel void sketch_block(__global const float* A, __global float* S, __local float* scratch, const int nr_elements,
+	const int block, const int samples, const uint seed) {
+	int lid = get_local_id(0);
+	int N = get_local_size(0);
+	int group = get_group_id(0);
+	int start = group * block;
+	int valid = min(block, nr_elements - start);
+
+	//load the block, positions past the data sort to the end
+	for (int i = lid; i < block; i += N)
+		scratch[i] = (i < valid) ? A[start + i] : INFINITY;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	//bitonic sort of the block, each work item handles block / 2 / N compare-exchange pairs per step
+	for (int k = 2; k <= block; k <<= 1) {
+		for (int j = k >> 1; j > 0; j >>= 1) {
+			for (int t = lid; t < block / 2; t += N) {
+				int i = 2 * j * (t / j) + (t % j);
+				float a = scratch[i];
+				float b = scratch[i + j];
+				if ((a > b) == ((i & k) == 0)) {
+					scratch[i] = b;
+					scratch[i + j] = a;
+				}
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+	}
+
+	//keep every w-th value from a pseudo random offset so the rounding of ranks averages out over groups
+	int w = block / samples;
+	uint h = (seed ^ (uint)group) * 2654435761u;
+	int offset = (int)((h ^ (h >> 16)) % (uint)w);
+	for (int i = lid; i < samples; i += N) {
+		int pos = offset + i * w;
+		S[group * samples + i] = (pos < valid) ? scratch[pos] : NAN;
+	}
+}
+
+// work-efficient (Blelloch) scan of one block of 2 * local size values per work group in local memory, local size a power of two
+// the up-sweep builds partial results in a tree, the root is kept as the block total and replaced by the identity,
+// then the down-sweep pushes the prefixes back down, about 2n operations instead of the n log n of a naive scan
+// B gets the exclusive scan of the block (or the inclusive one when inclusive is set) and T[group] the block total,
+// the host scans the totals the same way and scan_offset_* adds them back, see enqueueScan
+#define SCAN_BLOCK_KERNEL(NAME, TYPE, OP, NEUTRAL) \
+__kernel void NAME(__global const TYPE* A, __global TYPE* B, __global TYPE* T, __local TYPE* scratch, const int nr_elements, \
+	const int inclusive) { \
+	int lid = get_local_id(0); \
+	int half_block = get_local_size(0); \
+	int base = get_group_id(0) * 2 * half_block; \
+	int i0 = base + lid, i1 = base + lid + half_block; \
+	TYPE a0 = (i0 < nr_elements) ? A[i0] : NEUTRAL; \
+	TYPE a1 = (i1 < nr_elements) ? A[i1] : NEUTRAL; \
+	scratch[lid] = a0; \
+	scratch[lid + half_block] = a1; \
+	int offset = 1; \
+	for (int d = half_block; d > 0; d >>= 1) { \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+		if (lid < d) { \
+			int left = offset * (2 * lid + 1) - 1; \
+			int right = offset * (2 * lid + 2) - 1; \
+			scratch[right] = OP(scratch[left], scratch[right]); \
+		} \
+		offset <<= 1; \
+	} \
+	if (!lid) { \
+		T[get_group_id(0)] = scratch[2 * half_block - 1]; \
+		scratch[2 * half_block - 1] = NEUTRAL; \
+	} \
+	for (int d = 1; d <= half_block; d <<= 1) { \
+		offset >>= 1; \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+		if (lid < d) { \
+			int left = offset * (2 * lid + 1) - 1; \
+			int right = offset * (2 * lid + 2) - 1; \
+			TYPE t = scratch[left]; \
+			scratch[left] = scratch[right]; \
+			scratch[right] = OP(scratch[right], t); \
+		} \
+	} \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+	if (i0 < nr_elements) \
+		B[i0] = inclusive ? OP(scratch[lid], a0) : scratch[lid]; \
+	if (i1 < nr_elements) \
+		B[i1] = inclusive ? OP(scratch[lid + half_block], a1) : scratch[lid + half_block]; \
+}
+
+// second half of a scan over more than one block: every value gets the scanned total of all blocks before its own
+// one work item per value, the block of value i is i / (2 * local size) as in the block kernel
+#define SCAN_OFFSET_KERNEL(NAME, TYPE, OP) \
+__kernel void NAME(__global TYPE* B, __global const TYPE* offsets, const int nr_elements) { \
+	int i = get_global_id(0); \
+	if (i < nr_elements) \
+		B[i] = OP(offsets[i / (2 * get_local_size(0))], B[i]); \
+}
+
+SCAN_BLOCK_KERNEL(scan_add, float, OP_ADD, 0.0f)
+SCAN_BLOCK_KERNEL(scan_min, float, OP_MIN, INFINITY)
+SCAN_BLOCK_KERNEL(scan_max, float, OP_MAX, -INFINITY)
+SCAN_BLOCK_KERNEL(scan_add_int, int, OP_ADD, 0) // histogram counts, exact running totals for a CDF
+
+SCAN_OFFSET_KERNEL(scan_offset_add, float, OP_ADD)
+SCAN_OFFSET_KERNEL(scan_offset_min, float, OP_MIN)
+SCAN_OFFSET_KERNEL(scan_offset_max, float, OP_MAX)
+SCAN_OFFSET_KERNEL(scan_offset_add_int, int, OP_ADD)
+
+// rolling windows by van Herk/Gil-Werman, pass 1: A is cut into blocks of w values and every block gets its running sum, min and max
+// from the left (G, prefix) and from the right (H, suffix), one work item per block and direction
+// so the cost is about two operations per value and statistic whatever the window length
+// G and H hold nr_elements values for the sum, then as many for the min and the max
+__kernel void rolling_blocks(__global const float* A, __global float* G, __global float* H, const int nr_elements, const int w) {
+	int item = get_global_id(0);
+	int start = (item / 2) * w;
+	if (start >= nr_elements)
+		return;
+	int end = min(start + w, nr_elements);
+
+	__global float* P = (item % 2) ? H : G;
+	int first = (item % 2) ? end - 1 : start;
+	int step = (item % 2) ? -1 : 1;
+	float sum = 0.0f, lo = INFINITY, hi = -INFINITY;
+	for (int i = first; (i >= start) && (i < end); i += step) {
+		float a = A[i];
+		sum += a;
+		lo = OP_MIN(lo, a);
+		hi = OP_MAX(hi, a);
+		P[i] = sum;
+		P[nr_elements + i] = lo;
+		P[2 * nr_elements + i] = hi;
+	}
+}
+
+// pass 2, one work item per window: the window of w values starting at k is the end of one block and the start of the next,
+// so it is H[k] combined with G[k + w - 1], or just G[k + w - 1] when k starts a block and the window is that whole block
+// R gets nr_windows moving means, then as many moving mins and maxes
+__kernel void rolling_windows(__global const float* G, __global const float* H, __global float* R, const int nr_elements, const int w) {
+	int k = get_global_id(0);
+	int nr_windows = nr_elements - w + 1;
+	if (k >= nr_windows)
+		return;
+
+	int last = k + w - 1;
+	bool aligned = (k % w) == 0;
+	float sum = aligned ? G[last] : H[k] + G[last];
+	float lo = aligned ? G[nr_elements + last] : OP_MIN(H[nr_elements + k], G[nr_elements + last]);
+	float hi = aligned ? G[2 * nr_elements + last] : OP_MAX(H[2 * nr_elements + k], G[2 * nr_elements + last]);
+
+	R[k] = sum / w;
+	R[nr_windows + k] = lo;
+	R[2 * nr_windows + k] = hi;
+}
@@ -0,0 +1,55 @@
+//one reduction for any element type and operator, built once per (type, op) pair with build options (see Reduce.h)
+//  T                element type of the input in global memory, float, double, int or half
+//  ACC              type the values are combined in, wider than T where T would overflow or cannot be computed with
+//  ACC_MAX          largest ACC value, ACC_LOWEST the lowest
+//  IDENTITY         neutral value of the operator, e.g. 0 for add or ACC_MAX for min
+//  COMBINE(a, b)    the operator itself
+//  MINFN, MAXFN     min and max of two ACC, fmin/fmax for floating types so NaN is skipped, min/max for integers
+//  LOAD_HALF        read T with vload_half, so half data needs no cl_khr_fp16
+//  USE_DOUBLE       T or ACC is double, needs cl_khr_fp64
+
+#ifdef USE_DOUBLE
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+#ifdef LOAD_HALF
+#define LOAD(A, i) vload_half(i, A)
+#else
+#define LOAD(A, i) ((ACC)A[i])
+#endif
+
+//sequential addressing from scratch down to B[group], local size must be a power of two
+void reduce_local(__local ACC* scratch, __global ACC* B)
+{
+	int lid = get_local_id(0);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+		if (lid < s)
+			scratch[lid] = COMBINE(scratch[lid], scratch[lid + s]);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (!lid) B[get_group_id(0)] = scratch[0];
+}
+
+//first level, every work item folds its grid-stride slice of the input into a register
+__kernel void reduce_values(__global const T* A, __global ACC* B, __local ACC* scratch, const int nr_elements) {
+	ACC acc = IDENTITY;
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0))
+		acc = COMBINE(acc, LOAD(A, i));
+	scratch[get_local_id(0)] = acc;
+
+	reduce_local(scratch, B);
+}
+
+//every further level, merges the partial results of the level before until one is left
+__kernel void reduce_partials(__global const ACC* A, __global ACC* B, __local ACC* scratch, const int nr_elements) {
+	ACC acc = IDENTITY;
+	for (int i = get_global_id(0); i < nr_elements; i += get_global_size(0))
+		acc = COMBINE(acc, A[i]);
+	scratch[get_local_id(0)] = acc;
+
+	reduce_local(scratch, B);
+}
@@ -0,0 +1,297 @@
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#define __CL_ENABLE_EXCEPTIONS
+
+//non-interactive benchmark of the parallel statistics against the sequential versions, on made up data of any size
+//needs no data file and no keyboard so it can run from scripts, the exit code is 1 if any result is wrong
+//builds with the ParallelBenchmark project, or on Linux with any OpenCL runtime (e.g. pocl on a machine without a GPU):
+//  g++ -O2 -std=c++11 -I../ParallelAssessment1 bench.cpp -o bench -lOpenCL -pthread
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include <CL/cl.hpp>
+#include "Utils.h"
+#include "Functions.h"
+#include "StatsEngine.h"
+#include "Reduce.h" // generic reductions of other element types
+#include "NativeStats.h" // host percentiles to check against
+#include "Sketch.h" // approximate percentiles
+#include "Benchmark.h" // latency timing
+#include "Synthetic.h" // made up temperature data
+
+using namespace std;
+
+void print_help() {
+	cerr << "Application usage:" << endl;
+
+	cerr << "  -p : select platform " << endl;
+	cerr << "  -d : select device" << endl;
+	cerr << "  -l : list all platforms and devices" << endl;
+	cerr << "  -n : comma separated dataset sizes (default 10000,1000000,10000000)" << endl;
+	cerr << "  -g : comma separated data shapes, seasonal, uniform, skewed or outliers (default all)" << endl;
+	cerr << "  -t : timed runs of each operation (default 20)" << endl;
+	cerr << "  -k : kernel file (default ../ParallelAssessment1/my_kernels.cl)" << endl;
+	cerr << "  --seed : seed of the generated data (default 1)" << endl;
+	cerr << "  -e : rank error the approximate percentiles are checked against, as a fraction of the values (default 0.001)" << endl;
+	cerr << "  -h : print this message" << endl;
+}
+
+//comma separated list split into its items
+vector<string> splitList(const string& list)
+{
+	vector<string> items;
+	string item;
+	istringstream stream(list);
+	while (getline(stream, item, ','))
+		if (!item.empty())
+			items.push_back(item);
+	return items;
+}
+
+//one line of the results table, the parallel time is for data already on the device
+void printRow(const string& op, const Latency& sequential, const Latency& parallel, bool ok)
+{
+	std::cout << std::setw(16) << op << std::setw(12) << sequential.median_ms << std::setw(12) << sequential.p99_ms
+		<< std::setw(12) << parallel.median_ms << std::setw(12) << parallel.p99_ms
+		<< std::setw(10) << sequential.median_ms / std::max(parallel.median_ms, 1e-9) << (ok ? "ok" : "WRONG") << std::endl;
+}
+
+//times one generic reduction of a typed dataset against the same reduction on the host, the results have to match exactly
+//the first call builds the kernels for the (type, op) pair so it is left out of the timing
+template <typename T, typename Op>
+bool benchmarkReduce(StatsEngine& engine, int id, const vector<T>& values, const string& op, int trials)
+{
+	typename ReduceType<T>::Acc seq = 0, par = engine.reduce<T, Op>(id);
+	Latency seq_ms = latencyMs(trials, [&]() { seq = normalReduce<T, Op>(values.data(), values.size()); });
+	Latency par_ms = latencyMs(trials, [&]() { par = engine.reduce<T, Op>(id); });
+	printRow(op, seq_ms, par_ms, par == seq);
+	return par == seq;
+}
+
+//times every parallel operation on one generated dataset against its sequential version, false if any result is wrong
+bool benchmarkDataset(StatsEngine& engine, size_t nr_rows, SyntheticShape shape, unsigned int seed, int trials, double epsilon)
+{
+	TemperatureData data = generateTemperatures(nr_rows, shape, seed);
+	DataView A(data.values);
+	cl::Context& context = engine.getContext();
+	cl::Program& program = engine.getProgram();
+	cl::CommandQueue& queue = engine.getQueue();
+
+	int id = 0;
+	Latency upload = latencyMs(1, [&]() { id = engine.addDataset(A); });
+	Latency none = { 0, 0 };
+
+	std::cout << "--------------------------------------------------------------------------------------" << std::endl;
+	std::cout << nr_rows << " values, " << syntheticShapeName(shape) << ", " << trials << " runs, times in ms" << std::endl;
+	std::cout << "--------------------------------------------------------------------------------------" << std::endl;
+	std::cout << std::left << std::setw(16) << "operation" << std::setw(12) << "seq median" << std::setw(12) << "seq p99"
+		<< std::setw(12) << "par median" << std::setw(12) << "par p99" << std::setw(10) << "speedup" << "check" << std::endl;
+	printRow("upload", none, upload, true);
+
+	bool all_ok = true;
+
+	//min and max have to match exactly
+	mytype seq_min = 0, seq_max = 0, par_min = 0, par_max = 0;
+	Latency seq_min_ms = latencyMs(trials, [&]() { seq_min = *std::min_element(A.begin(), A.end()); });
+	Latency par_min_ms = latencyMs(trials, [&]() { par_min = engine.min(id); });
+	printRow("min", seq_min_ms, par_min_ms, par_min == seq_min);
+	all_ok = all_ok && (par_min == seq_min);
+
+	Latency seq_max_ms = latencyMs(trials, [&]() { seq_max = *std::max_element(A.begin(), A.end()); });
+	Latency par_max_ms = latencyMs(trials, [&]() { par_max = engine.max(id); });
+	printRow("max", seq_max_ms, par_max_ms, par_max == seq_max);
+	all_ok = all_ok && (par_max == seq_max);
+
+	//the mean within the tolerance of the engine's precision (see MeanPrecision), relative to the mean of the absolute values
+	//checked against accurateMean, normalMean is only timed as its own error on large inputs is above the tightest tolerance
+	double seq_mean = 0, par_mean = 0;
+	Latency seq_mean_ms = latencyMs(trials, [&]() { seq_mean = normalMean(context, program, queue, A); });
+	Latency par_mean_ms = latencyMs(trials, [&]() { par_mean = engine.mean(id); });
+	double scale = 0;
+	for (size_t i = 0; i < A.size(); i++)
+		scale += fabs(A[i]);
+	scale = std::max(scale / std::max(A.size(), (size_t)1), 1e-30);
+	double tolerance = meanTolerance(engine.getMeanPrecision());
+	bool mean_ok = (tolerance < 0) || (fabs(par_mean - accurateMean(A)) / scale <= tolerance);
+	printRow("mean", seq_mean_ms, par_mean_ms, mean_ok);
+	all_ok = all_ok && mean_ok;
+
+	//histograms have to match bin for bin, the larger counts go past local memory and use the global kernel
+	const int bins[] = { 10, 100, 1000, 10000 };
+	Summary summary = engine.summary(id);
+	for (int nr_bins : bins) {
+		BinLayout layout = uniformBins(floor(summary.min), ceil(summary.max) + 1, nr_bins);
+		Histogram seq_H, par_H;
+		Latency seq_ms = latencyMs(trials, [&]() { seq_H = normalHist(A, layout); });
+		Latency par_ms = latencyMs(trials, [&]() { par_H = engine.histogram(id, layout); });
+		bool ok = sameHistogram(seq_H, par_H);
+		printRow("histogram " + std::to_string(nr_bins), seq_ms, par_ms, ok);
+		all_ok = all_ok && ok;
+	}
+
+	//the bitonic sort has to give std::sort's order, its time includes the upload and read back of the padded copy
+	vector<mytype> seq_sorted, par_sorted;
+	Latency seq_sort_ms = latencyMs(trials, [&]() { seq_sorted.assign(A.begin(), A.end()); std::sort(seq_sorted.begin(), seq_sorted.end()); });
+	Latency par_sort_ms = latencyMs(trials, [&]() { par_sorted = parallelSort(context, program, queue, A); });
+	printRow("sort", seq_sort_ms, par_sort_ms, par_sorted == seq_sorted);
+	all_ok = all_ok && (par_sorted == seq_sorted);
+
+	//percentiles select the same ranks and interpolate the same way on both sides, so they match exactly
+	vector<double> ps = { 0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99 };
+	vector<double> seq_ps, par_ps;
+	Latency seq_ps_ms = latencyMs(trials, [&]() { seq_ps = nativePercentiles(A, ps); });
+	Latency par_ps_ms = latencyMs(trials, [&]() { par_ps = engine.percentiles(id, ps); });
+	printRow("percentiles", seq_ps_ms, par_ps_ms, par_ps == seq_ps);
+	all_ok = all_ok && (par_ps == seq_ps);
+
+	//the sketch quantiles are only expected within epsilon of the rank asked for, checked against where each value sits in the sorted data
+	vector<double> approx_ps;
+	Latency approx_ms = latencyMs(trials, [&]() { approx_ps = parallelApproxPercentiles(context, program, queue, A, ps, epsilon); });
+	bool approx_ok = (approx_ps.size() == ps.size()) && !seq_sorted.empty();
+	for (size_t i = 0; approx_ok && (i < ps.size()); i++) {
+		double first = std::lower_bound(seq_sorted.begin(), seq_sorted.end(), (mytype)approx_ps[i]) - seq_sorted.begin();
+		double last = std::upper_bound(seq_sorted.begin(), seq_sorted.end(), (mytype)approx_ps[i]) - seq_sorted.begin();
+		double target = ps[i] * seq_sorted.size(), allowed = epsilon * seq_sorted.size();
+		approx_ok = (target >= first - allowed) && (target <= last + allowed);
+	}
+	printRow("approx pct", seq_ps_ms, approx_ms, approx_ok);
+	all_ok = all_ok && approx_ok;
+
+	//running min and max have to match exactly, running sums within float rounding of the running sum of the absolute values
+	const ReduceOp scan_ops[] = { REDUCE_MIN, REDUCE_MAX, REDUCE_ADD };
+	const char* scan_names[] = { "running min", "running max", "running sum" };
+	for (int o = 0; o < 3; o++) {
+		vector<mytype> seq_S, par_S;
+		Latency seq_ms = latencyMs(trials, [&]() { seq_S = normalScan(A, scan_ops[o]); });
+		Latency par_ms = latencyMs(trials, [&]() { par_S = engine.scan(id, scan_ops[o]); });
+		bool ok = (par_S.size() == seq_S.size());
+		double abs_sum = 0;
+		for (size_t i = 0; ok && (i < seq_S.size()); i++) {
+			abs_sum += fabs(A[i]);
+			ok = (scan_ops[o] == REDUCE_ADD) ? (fabs(par_S[i] - seq_S[i]) <= 1e-3 * abs_sum) : (par_S[i] == seq_S[i]);
+		}
+		printRow(scan_names[o], seq_ms, par_ms, ok);
+		all_ok = all_ok && ok;
+	}
+
+	//the cdf from the device scan of the counts against running totals of the host histogram
+	BinLayout cdf_layout = uniformBins(floor(summary.min), ceil(summary.max) + 1, 100);
+	vector<double> seq_cdf, par_cdf;
+	Latency seq_cdf_ms = latencyMs(trials, [&]() {
+		Histogram H = normalHist(A, cdf_layout);
+		seq_cdf.assign(H.counts.size(), 0);
+		double running = H.underflow, total = (double)H.underflow + H.overflow;
+		for (size_t b = 0; b < H.counts.size(); b++)
+			total += H.counts[b];
+		for (size_t b = 0; b < H.counts.size(); b++)
+			seq_cdf[b] = total ? (running += H.counts[b]) / total : 0;
+	});
+	Latency par_cdf_ms = latencyMs(trials, [&]() { par_cdf = engine.cdf(id, cdf_layout); });
+	bool cdf_ok = (par_cdf.size() == seq_cdf.size());
+	for (size_t b = 0; cdf_ok && (b < seq_cdf.size()); b++)
+		cdf_ok = fabs(par_cdf[b] - seq_cdf[b]) <= 1e-12;
+	printRow("cdf 100", seq_cdf_ms, par_cdf_ms, cdf_ok);
+	all_ok = all_ok && cdf_ok;
+
+	//moving windows of a day, a week and a month of hourly readings, mins and maxes exact and means within float rounding
+	const int windows[] = { 24, 168, 720 };
+	for (int w : windows) {
+		if ((size_t)w > A.size())
+			continue;
+		Rolling seq_R, par_R;
+		Latency seq_ms = latencyMs(trials, [&]() { seq_R = normalRolling(A, w); });
+		Latency par_ms = latencyMs(trials, [&]() { par_R = engine.rolling(id, w); });
+		bool ok = (par_R.mean.size() == seq_R.mean.size());
+		for (size_t k = 0; ok && (k < seq_R.mean.size()); k++)
+			ok = (fabs(par_R.mean[k] - seq_R.mean[k]) <= 1e-3 * scale) && (par_R.min[k] == seq_R.min[k]) && (par_R.max[k] == seq_R.max[k]);
+		printRow("rolling " + std::to_string(w), seq_ms, par_ms, ok);
+		all_ok = all_ok && ok;
+	}
+
+	//the readings as whole tenths of a degree, sums of integers are exact so they must match bit for bit
+	vector<cl_int> tenths(A.size());
+	for (size_t i = 0; i < A.size(); i++)
+		tenths[i] = (cl_int)floor(A[i] * 10.0f + 0.5f);
+	int int_id = engine.addValues(tenths.data(), tenths.size());
+	all_ok = benchmarkReduce<cl_int, SumOp>(engine, int_id, tenths, "int sum", trials) && all_ok;
+	all_ok = benchmarkReduce<cl_int, MinOp>(engine, int_id, tenths, "int min", trials) && all_ok;
+	all_ok = benchmarkReduce<cl_int, MaxOp>(engine, int_id, tenths, "int max", trials) && all_ok;
+	engine.removeDataset(int_id);
+
+	//the readings with a missing value as NaN, min and max have to skip it on the device just as on the host
+	vector<cl_float> gappy(A.data(), A.data() + A.size());
+	if (!gappy.empty())
+		gappy[gappy.size() / 2] = NAN;
+	int nan_id = engine.addValues(gappy.data(), gappy.size());
+	all_ok = benchmarkReduce<cl_float, MinOp>(engine, nan_id, gappy, "nan min", trials) && all_ok;
+	all_ok = benchmarkReduce<cl_float, MaxOp>(engine, nan_id, gappy, "nan max", trials) && all_ok;
+	engine.removeDataset(nan_id);
+	std::cout << std::right;
+
+	engine.removeDataset(id);
+	return all_ok;
+}
+
+int main(int argc, char **argv)
+{
+	int platform_id = 0;
+	int device_id = 0;
+	string sizes = "10000,1000000,10000000";
+	string shapes = "seasonal,uniform,skewed,outliers";
+	int trials = 20;
+	string kernel_file = "../ParallelAssessment1/my_kernels.cl";
+	unsigned int seed = 1;
+	double epsilon = 0.001;
+
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "-p") == 0) && (i < (argc - 1))) { platform_id = atoi(argv[++i]); }
+		else if ((strcmp(argv[i], "-d") == 0) && (i < (argc - 1))) { device_id = atoi(argv[++i]); }
+		else if (strcmp(argv[i], "-l") == 0) { std::cout << ListPlatformsDevices() << endl; return 0; }
+		else if ((strcmp(argv[i], "-n") == 0) && (i < (argc - 1))) { sizes = argv[++i]; }
+		else if ((strcmp(argv[i], "-g") == 0) && (i < (argc - 1))) { shapes = argv[++i]; }
+		else if ((strcmp(argv[i], "-t") == 0) && (i < (argc - 1))) { trials = std::max(atoi(argv[++i]), 1); }
+		else if ((strcmp(argv[i], "-k") == 0) && (i < (argc - 1))) { kernel_file = argv[++i]; }
+		else if ((strcmp(argv[i], "--seed") == 0) && (i < (argc - 1))) { seed = (unsigned int)atoi(argv[++i]); }
+		else if ((strcmp(argv[i], "-e") == 0) && (i < (argc - 1))) { epsilon = atof(argv[++i]); }
+		else if (strcmp(argv[i], "-h") == 0) { print_help(); return 0; }
+		else { print_help(); return 2; }
+	}
+
+	vector<SyntheticShape> shape_list;
+	vector<string> shape_names = splitList(shapes);
+	for (size_t i = 0; i < shape_names.size(); i++) {
+		SyntheticShape shape;
+		if (!parseSyntheticShape(shape_names[i], shape)) {
+			std::cerr << "Unknown data shape " << shape_names[i] << std::endl;
+			return 2;
+		}
+		shape_list.push_back(shape);
+	}
+	vector<string> size_list = splitList(sizes);
+
+	bool all_ok = true;
+	try {
+		StatsEngine engine;
+		engine.init(platform_id, device_id, kernel_file);
+		std::cout << "Running on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << std::endl;
+
+		for (size_t s = 0; s < size_list.size(); s++)
+			for (size_t g = 0; g < shape_list.size(); g++)
+				all_ok = benchmarkDataset(engine, (size_t)atof(size_list[s].c_str()), shape_list[g], seed, trials, epsilon) && all_ok;
+	}
+	catch (cl::Error err) {
+		std::cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+		return 1;
+	}
+
+	std::cout << "--------------------------------------------------------------------------------------" << std::endl;
+	std::cout << (all_ok ? "All results match the sequential versions" : "Some results do NOT match the sequential versions") << std::endl;
+	return all_ok ? 0 : 1;
+}